@@ -0,0 +1,57 @@
+#pragma once
+#include "broadphase.h"
+
+// Dynamic bounding volume tree. Each circle owns a leaf with a fattened box, so a leaf is only
+// reinserted once its circle leaves the fat box. AVL style rotations keep the tree balanced.
+// Margins scale with radius, which keeps it efficient when radii span orders of magnitude.
+class AabbTree : public Broadphase {
+public:
+  explicit AabbTree(float marginRatio = 0.5f) : marginRatio(marginRatio) {}
+
+  void findPairs(const CircleWorld& circles, std::vector<CandidatePair>& pairs) override;
+  void findPairsParallel(const CircleWorld& circles, JobSystem& jobs, std::vector<std::vector<CandidatePair>>& chunks) override;
+  void circleRemoved(uint32_t i, uint32_t last) override;
+
+  // Refits leaves for moved circles; findPairs calls this itself
+  void update(const CircleWorld& circles);
+
+  // Appends the ids of every circle whose box overlaps region. Call update first if circles moved.
+  void queryRegion(const Aabb& region, const CircleWorld& circles, std::vector<uint32_t>& out) const;
+
+  int height() const { return root == nullNode ? 0 : nodes[root].height; }
+
+private:
+  static constexpr int nullNode = -1;
+
+  struct Node {
+    Aabb box;
+    int parent;
+    int child1;
+    int child2;
+    int height; // Leaves are 0
+    uint32_t body;
+
+    bool isLeaf() const { return child1 == nullNode; }
+  };
+
+  int allocateNode();
+  void freeNode(int node);
+  void insertLeaf(int leaf);
+  void removeLeaf(int leaf);
+  int balance(int node);
+  void fixUpwards(int node);
+  void queryPairs(const CircleWorld& circles, size_t begin, size_t end, std::vector<int>& pending,
+                  std::vector<CandidatePair>& pairs) const;
+  void clear();
+
+  static Aabb circleBox(const CircleWorld& circles, size_t i);
+  Aabb fatBox(const CircleWorld& circles, size_t i) const;
+
+  float marginRatio;
+  std::vector<Node> nodes;
+  int root = nullNode;
+  int freeList = nullNode;
+  std::vector<int> leafOf; // Leaf node for each circle
+  std::vector<int> stack;
+  std::vector<std::vector<int>> threadStacks;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include "force_field.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Softened pairwise gravity in O(n log n) through a Barnes-Hut quadtree. A cell whose side is smaller
+// than openingAngle times its distance to a circle acts as one mass at its centre of mass, so 0
+// gives the exact direct sum and larger angles trade accuracy for speed.
+//
+// The tree is rebuilt on every evaluation from Morton keys: keys are computed and radix sorted in
+// parallel, then the top cells are built as independent subtrees on the job system and stitched
+// together under a few serially built levels.
+class BarnesHutGravity : public ForceField {
+public:
+  explicit BarnesHutGravity(float openingAngle = 0.5f, float strength = defaultGravityStrength,
+                            float softening = defaultGravitySoftening)
+    : theta(openingAngle), strength(strength), softening(softening) {}
+
+  void accelerations(const CircleWorld& bodies, const float* x, const float* y, float* ax, float* ay,
+                     JobSystem* jobs) override;
+
+  void setOpeningAngle(float openingAngle) { theta = openingAngle; }
+  float openingAngle() const { return theta; }
+
+  // Cells in the last tree built
+  size_t nodeCount() const { return nodes.size(); }
+
+private:
+  struct Node {
+    float comX, comY; // Centre of mass
+    float mass;
+    float size;       // Side of the square cell
+    int32_t child[4]; // -1 where a quadrant is empty, all -1 for a leaf
+    uint32_t begin;   // Range of sorted circles in a leaf, empty for inner cells
+    uint32_t end;
+  };
+
+  struct Subtree {
+    std::vector<Node> nodes; // Root first, child indices local to this vector
+    uint32_t begin, end;
+    float size;
+  };
+
+  void sortByKey(const float* x, const float* y, size_t n, JobSystem* jobs);
+  int32_t buildNode(std::vector<Node>& out, uint32_t begin, uint32_t end, int level, float size) const;
+  int32_t linkTop(uint32_t cell, int level, float size);
+  void accumulateLeaf(Node& node) const;
+
+  float theta, strength, softening;
+
+  std::vector<uint32_t> keys, order;
+  std::vector<uint32_t> scratchKeys, scratchOrder;
+  std::vector<std::vector<uint32_t>> histograms; // Per chunk digit counts for the radix sort
+  std::vector<float> sortedX, sortedY, sortedMass;
+  std::vector<Subtree> subtrees;
+  std::vector<Node> nodes;
+  float rootSize = 1.0f;
+  int topLevels = 0; // Levels built serially above the subtrees
+};
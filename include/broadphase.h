@@ -0,0 +1,50 @@
+#pragma once
+#include "candidate_pair.h"
+#include "circle_world.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Axis aligned box, used for region queries
+struct Aabb {
+  float minX, minY, maxX, maxY;
+
+  bool overlaps(const Aabb& other) const {
+    return minX <= other.maxX && maxX >= other.minX && minY <= other.maxY && maxY >= other.minY;
+  }
+  bool contains(const Aabb& other) const {
+    return minX <= other.minX && minY <= other.minY && maxX >= other.maxX && maxY >= other.maxY;
+  }
+  float perimeter() const { return 2.0f * ((maxX - minX) + (maxY - minY)); }
+};
+
+class JobSystem;
+
+enum class BroadphaseKind {
+  BruteForce,
+  UniformGrid,
+  SweepAndPrune,
+  AabbTree
+};
+constexpr int broadphaseKindCount = 4;
+
+// Finds candidate pairs for the narrowphase. Implementations may keep state between steps.
+class Broadphase {
+public:
+  virtual ~Broadphase() = default;
+  virtual void findPairs(const CircleWorld& circles, std::vector<CandidatePair>& pairs) = 0;
+
+  // Same pairs as findPairs, split across chunks that the job system's threads fill independently
+  virtual void findPairsParallel(const CircleWorld& circles, JobSystem& jobs, std::vector<std::vector<CandidatePair>>& chunks);
+
+  // Circle i was removed and the last circle moved into its slot, as CircleWorld::remove does.
+  // Broadphases that keep state between steps patch it here rather than starting over.
+  virtual void circleRemoved(uint32_t /*i*/, uint32_t /*last*/) {}
+};
+
+// Returns nullptr for BruteForce, which World runs as a plain nested loop
+std::unique_ptr<Broadphase> createBroadphase(BroadphaseKind kind);
+
+const char* broadphaseName(BroadphaseKind kind);
+bool parseBroadphaseKind(const std::string& name, BroadphaseKind& kind);
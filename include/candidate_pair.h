@@ -0,0 +1,8 @@
+#pragma once
+#include <cstdint>
+
+// Pair of circle indices that may be touching, always with a < b
+struct CandidatePair {
+  uint32_t a;
+  uint32_t b;
+};
@@ -17,6 +17,8 @@ struct Circle {
   }
 
   float distanceTo(const Circle& other) const;
+  // Advances by dt with RK4 under the softened pairwise gravity of others, which hold still for the step.
+  // This circle may be in others, it is skipped. World integrates all circles at once through Integrator.
   void updateRK4(float dt, const std::vector<Circle>& others);
   void applyCollision(Circle& other);
 };
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+#include "circle.h"
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Alignment of every CircleWorld array, wide enough for a full AVX-512 register or a cache line
+constexpr size_t simdAlignment = 64;
+
+template <typename T, size_t Alignment>
+struct AlignedAllocator {
+  using value_type = T;
+  template <typename U> struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+  AlignedAllocator() = default;
+  template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+  }
+  void deallocate(T* p, size_t) {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+
+  template <typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+  template <typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, simdAlignment>>;
+
+// Structure of arrays storage for circles, so hot loops stream only the fields they touch.
+// Index i across every array is one circle.
+class CircleWorld {
+public:
+  AlignedVector<float> x, y;
+  AlignedVector<float> vx, vy;
+  AlignedVector<float> radius;
+  AlignedVector<float> invMass;
+
+  void add(const Circle& circle);
+  // Swaps the last circle into slot i, so indices past i are not stable
+  void remove(size_t i);
+  void clear();
+  void reserve(size_t count);
+
+  size_t size() const { return x.size(); }
+  bool empty() const { return x.empty(); }
+
+  // Compatibility view for code that works with a single Circle
+  Circle circle(size_t i) const;
+  void setCircle(size_t i, const Circle& circle);
+};
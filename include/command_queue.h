@@ -0,0 +1,51 @@
+#pragma once
+#include "broadphase.h"
+#include "circle.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// One change to a world, queued from any thread and applied by World::step
+struct Command {
+  enum class Type : uint8_t { Spawn, Remove, Impulse, Reset, SetBroadphase };
+
+  Type type = Type::Reset;
+  uint32_t body = 0; // Index for Remove and Impulse, as of when the command is applied
+  float x = 0.0f, y = 0.0f, vx = 0.0f, vy = 0.0f, radius = 0.0f, mass = 0.0f;
+  float impulseX = 0.0f, impulseY = 0.0f;
+  BroadphaseKind broadphase = BroadphaseKind::UniformGrid;
+
+  static Command spawn(const Circle& circle);
+  static Command remove(uint32_t body);
+  static Command impulse(uint32_t body, float impulseX, float impulseY);
+  static Command reset();
+  static Command setBroadphase(BroadphaseKind kind);
+};
+
+// Bounded lock-free queue with many producers and a single consumer. Each slot carries a sequence
+// number that says whose turn it is, so producers only contend on the tail counter and the
+// consumer never writes anything producers read except the slot it hands back.
+class CommandQueue {
+public:
+  // Capacity is rounded up to a power of two
+  explicit CommandQueue(size_t capacity = 1024);
+
+  // Any thread. Returns false instead of waiting when the queue is full.
+  bool push(const Command& command);
+  // Consumer thread only. Returns false when nothing is ready.
+  bool pop(Command& command);
+
+  size_t capacity() const { return mask + 1; }
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    Command command;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  size_t mask;
+  alignas(64) std::atomic<size_t> tail{0};
+  alignas(64) size_t head = 0;
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include "candidate_pair.h"
+#include "circle_world.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+struct CcdSettings {
+  bool enabled = true;
+  float motionThreshold = 1.0f; // Fraction of its radius a circle must move in one step to be swept
+  int maxImpacts = 4;           // Bounces followed per swept circle per step
+};
+
+// Time of impact sweeps for circles fast enough to pass through a neighbour or a wall in one step.
+// Runs just before integration. A swept circle is bounced at its first impact, elastically like
+// resolveContact, and its start position is shifted by (old velocity - new velocity) * impact time,
+// so the ordinary integrate that follows ends it exactly where the bounce would have taken it.
+class ContinuousCollision {
+public:
+  // Returns the number of circles swept. When no circle is fast this is one read-only pass over velocities.
+  size_t sweep(CircleWorld& bodies, float dt, float minBound, float maxBound, const CcdSettings& settings,
+               JobSystem* jobs);
+
+  // Circle pairs that collided in the last sweep
+  const std::vector<CandidatePair>& impacts() const { return hits; }
+
+private:
+  bool isFast(const CircleWorld& bodies, size_t i, float dt, float threshold) const;
+  void buildGrid(const CircleWorld& bodies, float dt, float minBound, float maxBound);
+  void cellRange(float lo, float hi, int& first, int& last) const;
+  void bounce(CircleWorld& bodies, uint32_t a, uint32_t b, float t);
+
+  std::vector<uint32_t> movers;
+  std::vector<uint8_t> moving;  // Nonzero for circles in movers
+  std::vector<float> eventTime; // Last bounce of each circle. Its path before then is not where it was.
+
+  // Every circle's box swept over the whole step, bucketed into a grid spanning the walls. Circles
+  // whose box covers too many cells are kept in a short list instead, checked by every mover.
+  float gridMin = 0.0f;
+  float cell = 1.0f;
+  int cols = 0;
+  std::vector<uint32_t> cellStart;
+  std::vector<uint32_t> cellEntries;
+  std::vector<uint32_t> cursor;
+  std::vector<uint32_t> oversized;
+  std::vector<uint32_t> seen; // Last query that visited each circle
+  uint32_t query = 0;
+
+  std::vector<CandidatePair> hits;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include "candidate_pair.h"
+#include "circle_world.h"
+#include "narrowphase.h"
+#include "uniform_grid.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Collision resolution with the world cut into vertical strips, one per task. Each domain copies
+// the circles it owns plus ghost copies of neighbours' circles within reach of its borders into its
+// own arrays, finds and resolves contacts there without sharing anything, then writes its circles
+// back. A contact across a border is resolved by the left domain, which hands the ghost's change
+// back to the owner. Circles migrate as they cross borders, and borders are re-split every so often
+// so each domain costs about the same measured time.
+class DomainDecomposition {
+public:
+  void setDomainCount(size_t count);
+  size_t domainCount() const { return domains.size(); }
+
+  // Steps between re-splits of the borders
+  void setRebalanceInterval(size_t steps) { rebalanceInterval = steps; }
+
+  // Circles were added or removed, so ownership is worked out from scratch next step
+  void invalidate() { assigned = false; }
+
+  // awake may be null when nothing sleeps. Pairs asleep on both sides are skipped. Returns the
+  // number of candidate pairs tested.
+  size_t resolveCollisions(CircleWorld& bodies, const uint8_t* awake, JobSystem& jobs);
+
+  // Touching pairs from the last step in world ids, one vector per domain
+  const std::vector<std::vector<CandidatePair>>& contactChunks() const { return contacts; }
+
+  // Borders between domains along x, domainCount() - 1 of them
+  std::vector<float> borders() const;
+  size_t ownedCount(size_t domain) const { return domains[domain].owned.size(); }
+  size_t ghostCount(size_t domain) const { return domains[domain].ghosts.size(); }
+  // Smoothed seconds the domain's solve phase took
+  double cost(size_t domain) const { return domains[domain].cost; }
+  // Slowest domain over the mean, 1 is perfectly balanced
+  double imbalance() const;
+
+private:
+  // Change to a ghost's state made by the domain that resolved it
+  struct GhostDelta {
+    uint32_t id;
+    float x, y, vx, vy;
+  };
+
+  struct Domain {
+    std::vector<uint32_t> owned;
+    std::vector<uint32_t> ghosts;
+    std::vector<uint32_t> ghostOwner;
+    std::vector<std::vector<uint32_t>> migrateTo; // Owned circles that left, by new domain
+    std::vector<std::vector<uint32_t>> ghostTo;   // Owned circles near a border, by domain that needs them
+    std::vector<std::vector<GhostDelta>> deltas;  // By owning domain, only ever to the right
+
+    CircleWorld local; // Owned circles first, then ghosts
+    UniformGrid grid;
+    std::vector<CandidatePair> pairs;
+    NarrowphaseScratch scratch;
+    double cost = 0.0;
+  };
+
+  size_t domainOf(float x) const;
+  void assignAll(const CircleWorld& bodies);
+  void rebalance(const CircleWorld& bodies);
+  void scan(size_t d, const CircleWorld& bodies);
+  void merge(size_t d);
+  size_t solve(size_t d, const CircleWorld& bodies, const uint8_t* awake);
+  void writeBack(size_t d, CircleWorld& bodies);
+
+  std::vector<Domain> domains;
+  std::vector<float> bounds; // domainCount() + 1 edges, the outer two infinite
+  std::vector<std::vector<CandidatePair>> contacts;
+  std::vector<size_t> pairTests;
+  float halo = 0.0f;         // Reach of a contact across a border, two of the largest radius
+  bool assigned = false;
+  size_t rebalanceInterval = 30;
+  size_t stepsSinceRebalance = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include "circle_world.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+struct EventStats {
+  uint64_t collisions = 0;
+  uint64_t wallBounces = 0;
+  uint64_t cellCrossings = 0;
+  uint64_t staleEvents = 0; // Popped after one of their circles had already moved on
+};
+
+// Exact hard disk dynamics for dilute gases, where stepping wastes nearly all its work on pairs that never
+// touch. Circles fly in straight lines between events, and the engine jumps from one predicted event to
+// the next: a circle meeting another, a wall, or the edge of its grid cell. Cells are at least one
+// diameter wide, so only circles in the 3x3 cells around one can be the next it meets.
+//
+// Predictions sit in a priority queue and are never removed. Each circle counts the events that changed
+// its velocity, every prediction records the counts it was made with, and a popped prediction whose
+// counts have moved on is dropped. Each circle keeps the time its position was last brought up to date, so an event only
+// touches the circles it involves.
+class EventDrivenSim {
+public:
+  // Takes a copy of the circles inside walls at minBound and maxBound on both axes. Circles that start
+  // overlapping are bounced apart by their first contact, without moving them.
+  void reset(const CircleWorld& circles, float minBound = -1.0f, float maxBound = 1.0f);
+
+  // Processes every event up to time, then brings every circle to it
+  void advanceTo(double time);
+
+  // Advances count times by interval and hands each snapshot to emit, for rendering or sampling
+  void sample(double interval, size_t count, const std::function<void(double, const CircleWorld&)>& emit);
+
+  double time() const { return now; }
+  // Positions are current as of the last advanceTo
+  const CircleWorld& circles() const { return bodies; }
+  const EventStats& stats() const { return counters; }
+  size_t pendingEvents() const { return queue.size(); }
+
+private:
+  // other is a circle index, or one of the kinds below
+  static constexpr int32_t wallX = -1;
+  static constexpr int32_t wallY = -2;
+  static constexpr int32_t crossX = -3;
+  static constexpr int32_t crossY = -4;
+
+  struct Event {
+    double time;
+    uint32_t a;
+    int32_t other;
+    uint32_t countA, countB;
+  };
+  struct Later {
+    bool operator()(const Event& l, const Event& r) const { return l.time > r.time; }
+  };
+
+  void predict(uint32_t i);
+  void predictCrossing(uint32_t i);
+  void predictContacts(uint32_t i, int x0, int x1, int y0, int y1);
+  void push(uint32_t a, int32_t other, double time);
+  void drift(uint32_t i, double time);
+  void process(const Event& event);
+  void moveToCell(uint32_t i, int cx, int cy);
+  void rebuildQueue();
+
+  CircleWorld bodies;
+  std::vector<double> stamp;     // Time each circle's position was last brought up to date
+  std::vector<uint32_t> counts;  // Collisions and wall bounces each circle has taken part in
+  double now = 0.0;
+  float minBound = -1.0f;
+  float maxBound = 1.0f;
+
+  std::priority_queue<Event, std::vector<Event>, Later> queue;
+  size_t queueLimit = 0; // Size at which the queue is rebuilt to shed stale predictions
+
+  float cell = 2.0f;
+  int cols = 1;
+  std::vector<std::vector<uint32_t>> members; // Circles in each cell
+  std::vector<int> cellX, cellY;              // Cell of each circle
+  std::vector<uint32_t> slot;                 // Position of each circle in its cell's members
+
+  EventStats counters;
+};
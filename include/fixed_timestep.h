@@ -0,0 +1,22 @@
+#pragma once
+#include "world.h"
+
+// Steps a world at a fixed rate from variable frame times. Leftover time carries over in an
+// accumulator, and a cap on steps per frame drops time instead of spiralling after a slow frame.
+class FixedTimestep {
+public:
+  explicit FixedTimestep(float stepSize = 1.0f / 120.0f, int maxStepsPerFrame = 8);
+
+  // Returns how many steps were taken
+  int advance(World& world, float frameTime);
+
+  // How far between the previous and current step the frame is, for World::packInstances
+  float alpha() const { return accumulator / stepSize; }
+
+  float step() const { return stepSize; }
+
+private:
+  float stepSize;
+  int maxStepsPerFrame;
+  float accumulator = 0.0f;
+};
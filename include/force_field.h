@@ -0,0 +1,56 @@
+#pragma once
+#include "circle_world.h"
+#include <cstddef>
+
+class JobSystem;
+
+// Pairwise gravity used by PairwiseGravity and Circle::updateRK4 unless told otherwise. Softening keeps
+// the pull finite when two centres get close.
+constexpr float defaultGravityStrength = 1e-4f;
+constexpr float defaultGravitySoftening = 0.01f;
+
+// Source of accelerations for the integrators. Forces may depend on positions only.
+class ForceField {
+public:
+  virtual ~ForceField() = default;
+
+  // Writes the acceleration of every circle as if circle i sat at x[i], y[i]. Mass and radius come from
+  // bodies, while x and y may be a trial state of an integrator rather than bodies.x and bodies.y.
+  virtual void accelerations(const CircleWorld& bodies, const float* x, const float* y, float* ax, float* ay,
+                             JobSystem* jobs) = 0;
+};
+
+// The same acceleration everywhere, such as gravity near the ground
+class UniformField : public ForceField {
+public:
+  UniformField(float gx, float gy) : gx(gx), gy(gy) {}
+  void accelerations(const CircleWorld& bodies, const float* x, const float* y, float* ax, float* ay,
+                     JobSystem* jobs) override;
+
+private:
+  float gx, gy;
+};
+
+// Spring pulling every circle towards the origin, a = -stiffness * p. Has an exact solution, which makes
+// it the reference problem for measuring integrator error.
+class CentralSpring : public ForceField {
+public:
+  explicit CentralSpring(float stiffness) : stiffness(stiffness) {}
+  void accelerations(const CircleWorld& bodies, const float* x, const float* y, float* ax, float* ay,
+                     JobSystem* jobs) override;
+
+private:
+  float stiffness;
+};
+
+// Softened Newtonian attraction between every pair of circles, summed directly in O(n²)
+class PairwiseGravity : public ForceField {
+public:
+  explicit PairwiseGravity(float strength = defaultGravityStrength, float softening = defaultGravitySoftening)
+    : strength(strength), softening(softening) {}
+  void accelerations(const CircleWorld& bodies, const float* x, const float* y, float* ax, float* ay,
+                     JobSystem* jobs) override;
+
+private:
+  float strength, softening;
+};
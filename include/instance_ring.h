@@ -0,0 +1,54 @@
+#pragma once
+#include "world.h"
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+// Streams circle positions to the GPU without waiting on frames it is still drawing. The buffer holds
+// three regions, each frame writes the next one and draws from it, and a fence after the draw keeps the
+// region from being written again before the GPU is done with it.
+//
+// With GL_ARB_buffer_storage the buffer stays mapped for its whole life and frames copy straight into
+// it. Without it (plain GL 3.3) each frame maps its region unsynchronized behind the same fences.
+// Either way only the ranges that changed are copied, and each region catches up on the ranges the
+// other two were given since it was last written, so sleeping circles are never uploaded again.
+class InstanceRing {
+public:
+  static constexpr int regionCount = 3;
+
+  InstanceRing() = default;
+  InstanceRing(const InstanceRing&) = delete;
+  InstanceRing& operator=(const InstanceRing&) = delete;
+
+  // Both need a current context, so destroy has to run before the window goes away. create picks
+  // persistent mapping when the driver has it.
+  void create();
+  void destroy();
+
+  // Copies ranges of data, x/y per circle for count circles, into the next region. A change of count
+  // invalidates every region, ranges then have to cover all the circles.
+  void upload(const float* data, size_t count, const std::vector<BodyRange>& ranges);
+
+  // Points attribute at the region last uploaded, call with the circle VAO bound
+  void bindAttribute(GLuint attribute) const;
+
+  // Call after the draw that reads the region last uploaded
+  void fence();
+
+  bool persistent() const { return persistentMapping; }
+
+private:
+  void reserve(size_t circles);
+  void waitFor(int index);
+
+  GLuint buffer = 0;
+  bool persistentMapping = false;
+  float* mapped = nullptr; // Whole buffer while persistently mapped
+  size_t capacity = 0;     // Circles per region
+  size_t count = 0;
+  int region = regionCount - 1;
+
+  GLsync fences[regionCount] = {};
+  std::vector<BodyRange> behind[regionCount]; // Ranges other regions got since each was last written
+  std::vector<BodyRange> spans;               // Merged ranges copied this frame
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include "circle_world.h"
+#include "force_field.h"
+#include <string>
+
+class JobSystem;
+
+enum class IntegratorKind {
+  ExplicitEuler,     // Position from the old velocity, then velocity. First order, gains energy.
+  SemiImplicitEuler, // Velocity first, then position from the new one. First order but symplectic.
+  VelocityVerlet,    // Second order and symplectic, one force evaluation per step once warmed up
+  Rk4                // Fourth order, four force evaluations per step, slowly loses energy
+};
+constexpr int integratorKindCount = 4;
+
+const char* integratorName(IntegratorKind kind);
+bool parseIntegratorKind(const std::string& name, IntegratorKind& kind);
+
+// Advances every circle under a force field. Each scheme is a short sequence of whole-array kernels,
+// so all circles move through one stage before any moves through the next.
+class Integrator {
+public:
+  void setKind(IntegratorKind kind);
+  IntegratorKind kind() const { return integratorKind; }
+
+  // Moves every circle by dt under field, then reflects circles off the [minBound, maxBound] box
+  void step(CircleWorld& bodies, ForceField& field, float dt, float minBound, float maxBound, JobSystem* jobs);
+
+  // Velocity Verlet reuses the accelerations from the end of the previous step. Call this whenever
+  // positions, the set of circles or the field changed in between.
+  void invalidate() { accelerationsValid = false; }
+
+  size_t forceEvaluations() const { return evaluations; }
+
+private:
+  void evaluate(CircleWorld& bodies, ForceField& field, const float* x, const float* y, JobSystem* jobs);
+  void stepRk4(CircleWorld& bodies, ForceField& field, float dt, JobSystem* jobs);
+
+  IntegratorKind integratorKind = IntegratorKind::SemiImplicitEuler;
+  AlignedVector<float> ax, ay;
+  AlignedVector<float> trialX, trialY, trialVx, trialVy; // RK4 stage state
+  AlignedVector<float> sumX, sumY, sumVx, sumVy;         // RK4 weighted slopes
+  bool accelerationsValid = false;
+  size_t evaluations = 0;
+};
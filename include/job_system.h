@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+class TaskGraph;
+
+// Unit of work sitting in a deque: either a slice of a parallelFor range or one graph node
+struct JobTask {
+  struct RangeGroup* group = nullptr;
+  size_t begin = 0;
+  size_t end = 0;
+  TaskGraph* graph = nullptr;
+  size_t node = 0;
+};
+
+// Small dependency graph of tasks, built once and run as often as needed by JobSystem::run.
+// A task may itself call JobSystem::parallelFor.
+class TaskGraph {
+public:
+  using Node = size_t;
+
+  Node add(std::function<void()> work);
+  // after will not start until before has finished
+  void precede(Node before, Node after);
+  void clear();
+
+  size_t size() const { return nodes.size(); }
+
+private:
+  friend class JobSystem;
+
+  struct Entry {
+    std::function<void()> work;
+    std::vector<Node> successors;
+    int dependencies = 0;
+  };
+
+  std::vector<Entry> nodes;
+  std::vector<JobTask> tasks;
+  std::unique_ptr<std::atomic<int>[]> pending;
+  std::atomic<size_t> remaining{0};
+};
+
+// Persistent worker threads with one deque each. Owners push and pop at the back, idle threads
+// steal from the front of someone else's deque, so skewed work spreads out on its own.
+// The thread that calls parallelFor or run joins in as thread 0; call from one such thread at a time.
+// A worker of another job system counts as an outside thread here.
+class JobSystem {
+public:
+  using RangeBody = std::function<void(size_t, size_t, unsigned)>;
+
+  explicit JobSystem(unsigned threadCount);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+  // Calls body(begin, end, thread) over [0, count). Ranges are split in halves down to grain
+  // as other threads steal them. Returns once every index has been processed.
+  void parallelFor(size_t count, size_t grain, const RangeBody& body);
+
+  // Runs every node of the graph once its predecessors are done, returns when all have finished
+  void run(TaskGraph& graph);
+
+private:
+  using Task = JobTask;
+
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Task*> tasks;
+  };
+
+  void workerLoop(unsigned thread);
+  void push(unsigned thread, Task* task);
+  Task* pop(unsigned thread);
+  Task* steal(unsigned thread);
+  bool runOne(unsigned thread);
+  void execute(Task* task, unsigned thread);
+  void helpUntil(const std::atomic<size_t>& remaining);
+  // Index of the calling thread in this system, 0 for threads that are not one of its workers
+  unsigned currentThread() const;
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::thread> workers;
+
+  std::atomic<int> queued{0};
+  std::atomic<int> sleepers{0};
+  std::atomic<bool> stopping{false};
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include "candidate_pair.h"
+#include <cstddef>
+#include <cstdint>
+
+// Instruction set a kernel table was built for, in increasing order of capability
+enum class IsaLevel {
+  Scalar,
+  Sse2,
+  Sse42,
+  Avx2,
+  Avx512
+};
+
+// Hot loops compiled once per instruction set. The best table the CPU supports is picked on first use;
+// set COLLISION_ISA=scalar|sse2|sse42|avx2|avx512 to force a lower one for benchmarking.
+struct PhysicsKernels {
+  IsaLevel isa;
+  size_t lanes;
+
+  // Advances positions by velocity * dt and reflects circles off the [minBound, maxBound] box
+  void (*integrateBounded)(float* x, float* y, float* vx, float* vy, const float* radius, size_t count,
+                           float dt, float minBound, float maxBound);
+
+  // out[i] = a[i] + scale * b[i]. out may be the same array as a or b.
+  void (*addScaled)(float* out, const float* a, const float* b, float scale, size_t count);
+
+  // Copies the pairs whose circles currently overlap into out and returns how many there were.
+  // out may be the same array as pairs.
+  size_t (*filterContacts)(const float* x, const float* y, const float* radius,
+                           const CandidatePair* pairs, size_t count, CandidatePair* out);
+
+  // Resolves exactly `lanes` contacts, none of which may share a body
+  void (*resolveContactBatch)(float* x, float* y, float* vx, float* vy, const float* radius,
+                              const float* invMass, const CandidatePair* batch);
+
+  // Grid cell index of each circle, cy * cols + cx, clamped to the last row and column
+  void (*cellKeys)(const float* x, const float* y, size_t count, float minX, float minY, float cell,
+                   int cols, int rows, uint32_t* out);
+};
+
+const PhysicsKernels& physicsKernels();
+
+// Switches every kernel to the given level. Returns false, leaving the table alone, if the CPU lacks it.
+bool setPhysicsKernels(IsaLevel level);
+
+IsaLevel detectIsaLevel();
+const char* isaName(IsaLevel level);
+bool parseIsaLevel(const char* name, IsaLevel& level);
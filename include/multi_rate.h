@@ -0,0 +1,79 @@
+#pragma once
+#include "broadphase.h"
+#include "candidate_pair.h"
+#include "circle_world.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class JobSystem;
+
+struct MultiRateSettings {
+  bool enabled = false;
+  // Fraction of its radius a circle must move in one step to be substepped, the same as
+  // CcdSettings::motionThreshold so multi-rate takes over exactly the circles CCD would sweep
+  float threshold = 1.0f;
+  float courant = 0.25f;           // Fraction of its radius a fast circle may move in one of its substeps
+  int maxLevels = 6;               // Finest substep is dt / 2^maxLevels
+  float maxActiveFraction = 0.1f;  // Above this share of the world substepped, step at a single rate with CCD
+};
+
+// Multi-rate stepping: a few fast circles no longer force a small step on the whole world. A circle
+// moving more than threshold of its radius in a step is put on a level, taking 2^level substeps per
+// step, the fewest that keep it within courant of its radius per substep. Every circle that can come
+// within touching distance of a fast circle's path this step joins it on its level, so anything it
+// could hit moves in the same substeps. The rest are not touched.
+//
+// Substepping only pays while the fast circles and their neighbours are a small part of the world.
+// When more than maxActiveFraction would be substepped, nothing is, and the step falls back to a
+// single rate with the CCD sweep.
+//
+// The substepped circles are gathered before the ordinary integrate, stepped on their own with the
+// same contact and wall resolution, and written back over whatever the ordinary integrate did to them.
+class MultiRate {
+public:
+  // Picks the circles to substep and copies them aside. Returns how many there are, 0 when nothing is
+  // fast or too much would be substepped. When nothing is fast this is one read-only pass over
+  // velocities. Sleeping circles are never substepped, only reported through touched().
+  size_t prepare(const CircleWorld& bodies, const uint8_t* awake, float dt, const MultiRateSettings& settings,
+                 JobSystem* jobs);
+
+  // Sleeping circles inside a fast circle's reach, paired with it, for waking
+  const std::vector<CandidatePair>& touched() const { return sleepers; }
+
+  // Substeps the circles picked by prepare and writes them back into bodies
+  void finish(CircleWorld& bodies);
+
+  // Substeps of the finest level in the last step, 1 when nothing was fast
+  size_t substeps() const { return finestSteps; }
+
+private:
+  void buildReachGrid(const CircleWorld& bodies, float slack);
+  void reachRange(float lo, float hi, int& first, int& last) const;
+
+  std::vector<uint8_t> level; // Substep level of every circle, 0 for one step
+  std::vector<uint32_t> fast;
+  std::vector<CandidatePair> sleepers;
+  float stepDt = 0.0f;
+  int finest = 0;
+  size_t finestSteps = 1;
+
+  // Paths of fast circles this step, bucketed like ContinuousCollision's swept boxes
+  std::vector<Aabb> reach;
+  std::vector<uint8_t> reachLevel; // Level of each fast circle before neighbours were raised
+  Aabb reachBounds{0.0f, 0.0f, 0.0f, 0.0f}; // Around every reach, widened like the buckets
+  float cell = 2.0f;
+  int cols = 1;
+  std::vector<uint32_t> cellStart;
+  std::vector<uint32_t> cellEntries;
+  std::vector<uint32_t> cursor;
+  std::vector<uint32_t> oversized;
+
+  // The substepped circles, sorted by level so each level is one run for the integrate kernel
+  std::vector<uint32_t> active;
+  std::vector<uint32_t> levelStart;
+  CircleWorld local;
+  std::unique_ptr<Broadphase> localBroadphase;
+  std::vector<CandidatePair> pairs;
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include "broadphase.h"
+#include "circle_world.h"
+#include <algorithm>
+#include <vector>
+
+// The elastic impulse of Circle::applyCollision along the unit normal (nx, ny), which points from b to a.
+// Returns false and leaves the velocities alone if the pair is already separating.
+bool applyElasticImpulse(CircleWorld& bodies, uint32_t a, uint32_t b, float nx, float ny);
+
+// Same elastic impulse and overlap fix as Circle::applyCollision, working on CircleWorld arrays
+void resolveContact(CircleWorld& bodies, uint32_t a, uint32_t b);
+void resolvePairs(CircleWorld& bodies, const CandidatePair* pairs, size_t count);
+
+// Buffers for the batched narrowphase, kept between steps so it does not allocate
+struct NarrowphaseScratch {
+  std::vector<CandidatePair> contacts;
+  std::vector<CandidatePair> deferred;
+  std::vector<uint32_t> stamp; // Last batch each body was placed in
+  uint32_t batch = 0;
+
+  uint32_t nextBatch() {
+    if (++batch == 0) {
+      std::fill(stamp.begin(), stamp.end(), 0);
+      batch = 1;
+    }
+    return batch;
+  }
+};
+
+// Drops candidates that do not overlap, then resolves the contacts in SIMD batches using the active kernels.
+// Pairs that become overlapping only through this step's overlap fixes are picked up next step.
+void resolvePairsBatched(CircleWorld& bodies, const CandidatePair* pairs, size_t count, NarrowphaseScratch& scratch);
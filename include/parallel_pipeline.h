@@ -0,0 +1,51 @@
+#pragma once
+#include "broadphase.h"
+#include "circle_world.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class JobSystem;
+
+// Multithreaded collision resolution. The broadphase runs in parallel chunks, then contacts are
+// greedily coloured so no two contacts of one colour share a body. Each colour is then resolved
+// in parallel without locks, one colour after another.
+class ParallelPipeline {
+public:
+  // Runs every phase in order. Returns the number of candidate pairs tested.
+  size_t resolveCollisions(CircleWorld& bodies, Broadphase& broadphase, JobSystem& jobs);
+
+  // The phases on their own, for callers that schedule them as a task graph. clearMasks does not
+  // depend on findContacts, colorContacts needs both, resolveColors needs colorContacts.
+  size_t findContacts(const CircleWorld& bodies, Broadphase& broadphase, JobSystem& jobs);
+  void clearMasks(size_t bodyCount, JobSystem& jobs);
+  void colorContacts(JobSystem& jobs);
+  void resolveColors(CircleWorld& bodies, JobSystem& jobs);
+
+  // Touching pairs left by findContacts, one vector per chunk. Pairs may be dropped from them
+  // before colorContacts runs.
+  std::vector<std::vector<CandidatePair>>& contactChunks() { return chunks; }
+
+  // Contacts bucketed by colour by colorContacts. Colour k is [colorOffsets()[k], colorOffsets()[k + 1]) and
+  // the overflow bucket, which must be resolved serially, runs up to colorOffsets()[maxColors + 1].
+  const std::vector<CandidatePair>& coloredContacts() const { return sorted; }
+  const size_t* colorOffsets() const { return colorStart; }
+
+  // Colours used by the last step, not counting the serial overflow bucket
+  size_t colorCount() const { return usedColors; }
+
+  static constexpr int maxColors = 64;
+
+private:
+  std::vector<std::vector<CandidatePair>> chunks;
+  std::vector<std::vector<uint8_t>> chunkColors;
+  std::vector<std::vector<size_t>> chunkOffsets; // Per chunk write cursor for each colour
+
+  std::unique_ptr<std::atomic<uint64_t>[]> colorMasks; // Colours already taken at each body
+  size_t maskCapacity = 0;
+
+  std::vector<CandidatePair> sorted; // Contacts bucketed by colour, overflow last
+  size_t colorStart[maxColors + 2] = {};
+  size_t usedColors = 0;
+};
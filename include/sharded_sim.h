@@ -0,0 +1,31 @@
+#pragma once
+#include "circle_world.h"
+#include <cstddef>
+#include <cstdint>
+
+struct ShardSettings {
+  size_t shards = 2;
+  size_t steps = 1000;
+  float dt = 1.0f / 60.0f;
+  unsigned linkLatencyMicros = 0; // Added before every halo message to model a slower network
+};
+
+struct ShardStats {
+  uint64_t pairTests = 0;
+  uint64_t haloBytes = 0;    // Sent between shards, both directions
+  uint64_t haloMessages = 0;
+  uint64_t migrations = 0;   // Circles handed to a neighbour
+  uint64_t ghosts = 0;       // Ghost copies received, summed over steps
+  double exchangeSeconds = 0.0; // Summed over shards, includes waiting on the slower neighbour
+  double computeSeconds = 0.0;  // Summed over shards
+  double wallSeconds = 0.0;
+};
+
+// Runs the circles in separate worker processes, each owning one vertical strip of the box.
+// Neighbouring workers swap the circles that crossed their border and ghost copies of the circles
+// near it over Unix domain sockets every step, so everything a worker knows about another arrives
+// as bytes on a socket, as it would over a network. A contact across a border is resolved by both
+// workers from the same ghost data, and each keeps only its own circle's result. The calling
+// process coordinates: it hands out the circles, collects per step stats and gathers the final
+// state back into circles. Linux only. Returns false if the processes could not be set up.
+bool runSharded(CircleWorld& circles, const ShardSettings& settings, ShardStats& stats);
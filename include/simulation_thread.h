@@ -0,0 +1,53 @@
+#pragma once
+#include "fixed_timestep.h"
+#include "triple_buffer.h"
+#include "world.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Circle positions as of one published step, for the render thread
+struct InstanceSnapshot {
+  std::vector<float> current;    // x/y per circle, laid out like World::packInstances
+  std::vector<float> previous;   // The same circles one step earlier
+  std::vector<BodyRange> ranges; // Runs that moved since the previous snapshot, only these are valid
+  size_t count = 0;
+  double time = 0.0;             // Steady clock seconds when current was reached
+  float stepSize = 0.0f;
+
+  // How far the frame at now is between previous and current
+  float alpha(double now) const;
+};
+
+// Steps a world on a dedicated thread at a fixed rate, independent of vsync and frame time.
+// While running, the world belongs to that thread: other threads change it through World::submit
+// and read positions from the snapshots it publishes, neither of which blocks the simulation.
+class SimulationThread {
+public:
+  explicit SimulationThread(World& world, float stepSize = 1.0f / 120.0f, int maxStepsPerFrame = 8);
+  ~SimulationThread();
+
+  SimulationThread(const SimulationThread&) = delete;
+  SimulationThread& operator=(const SimulationThread&) = delete;
+
+  void start();
+  void stop();
+
+  // Picks up the newest snapshot if one was published, returns whether snapshot() changed.
+  // A new snapshot is only published once the previous one has been picked up, so a reader that
+  // calls this every frame sees every snapshot and can apply their ranges one after another.
+  bool update() { return snapshots.update(); }
+  const InstanceSnapshot& snapshot() const { return snapshots.front(); }
+
+private:
+  void run();
+  void publish();
+
+  World& world;
+  FixedTimestep timestep;
+  TripleBuffer<InstanceSnapshot> snapshots;
+  size_t publishedCount = 0;
+
+  std::atomic<bool> stopping{false};
+  std::thread thread;
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include "broadphase.h"
+
+// Sweep and prune along x. The sorted order is kept between steps and repaired with insertion sort,
+// which is close to linear when bodies only move a little each frame. A fresh or much grown list is
+// sorted outright, and removals patch the list in place.
+class SweepAndPrune : public Broadphase {
+public:
+  void findPairs(const CircleWorld& circles, std::vector<CandidatePair>& pairs) override;
+  void findPairsParallel(const CircleWorld& circles, JobSystem& jobs, std::vector<std::vector<CandidatePair>>& chunks) override;
+  void circleRemoved(uint32_t i, uint32_t last) override;
+
+private:
+  struct Interval {
+    float minX, maxX;
+    float minY, maxY;
+    uint32_t id;
+  };
+
+  void refresh(const CircleWorld& circles);
+  void sweep(size_t begin, size_t end, std::vector<CandidatePair>& pairs) const;
+
+  std::vector<Interval> intervals; // Sorted by minX as of the last step
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+
+// Lock-free hand-off of whole values from one writer thread to one reader thread. The writer fills
+// back() and publishes it, the reader picks up the newest published value with update(). Neither
+// side ever waits: the three slots are swapped through a single atomic holding the middle index.
+template <typename T>
+class TripleBuffer {
+public:
+  // Slot the writer fills, owned by the writer until publish
+  T& back() { return slots[backIndex]; }
+
+  void publish() {
+    backIndex = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel) & indexMask;
+  }
+
+  // True once the reader has picked up the last published slot
+  bool consumed() const { return (middle.load(std::memory_order_acquire) & freshBit) == 0; }
+
+  // Swaps in the newest published slot if there is one, returns whether front() changed
+  bool update() {
+    if ((middle.load(std::memory_order_relaxed) & freshBit) == 0) return false;
+    frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & indexMask;
+    return true;
+  }
+
+  // Slot the reader looks at, stays put until the next update
+  const T& front() const { return slots[frontIndex]; }
+
+private:
+  static constexpr unsigned indexMask = 3;
+  static constexpr unsigned freshBit = 4;
+
+  T slots[3];
+  alignas(64) std::atomic<unsigned> middle{1};
+  alignas(64) unsigned backIndex = 0;
+  alignas(64) unsigned frontIndex = 2;
+};
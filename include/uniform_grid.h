@@ -0,0 +1,28 @@
+#pragma once
+#include "broadphase.h"
+
+// Uniform grid over the bounds of the circles, rebuilt every step with a counting sort.
+// Cells are at least one largest diameter wide, so touching circles always share a cell or a neighbour.
+class UniformGrid : public Broadphase {
+public:
+  void findPairs(const CircleWorld& circles, std::vector<CandidatePair>& pairs) override;
+  void findPairsParallel(const CircleWorld& circles, JobSystem& jobs, std::vector<std::vector<CandidatePair>>& chunks) override;
+
+  float cellSize() const { return cell; }
+
+private:
+  void build(const CircleWorld& circles);
+  void emitCellPairs(uint32_t cellA, uint32_t cellB, std::vector<CandidatePair>& pairs) const;
+  void emitRows(int firstRow, int lastRow, std::vector<CandidatePair>& pairs) const;
+
+  float minX = 0.0f;
+  float minY = 0.0f;
+  float cell = 1.0f;
+  int cols = 0;
+  int rows = 0;
+
+  std::vector<uint32_t> cellOf;    // Cell index of each circle
+  std::vector<uint32_t> cellStart; // Prefix offsets into sorted, one past the last cell included
+  std::vector<uint32_t> sorted;    // Circle indices ordered by cell
+  std::vector<uint32_t> cursor;
+};
@@ -0,0 +1,215 @@
+#pragma once
+#include "broadphase.h"
+#include "circle.h"
+#include "circle_world.h"
+#include "command_queue.h"
+#include "contact_solver.h"
+#include "continuous_collision.h"
+#include "domain_decomposition.h"
+#include "force_field.h"
+#include "integrator.h"
+#include "narrowphase.h"
+#include "job_system.h"
+#include "multi_rate.h"
+#include "parallel_pipeline.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Bodies that stay slower than speedThreshold for timeToSleep seconds, together with everything
+// they touch, stop being simulated until an awake body runs into them.
+struct SleepSettings {
+  bool enabled = true;
+  float speedThreshold = 0.02f;
+  float timeToSleep = 0.5f;
+};
+
+// Step sizes for World::stepAdaptive. Each step is as long as it can be without any circle moving more
+// than courant of its own radius, or, going by the last step, approaching contacts sinking further than
+// maxPenetration of the smaller radius. A calm world steps at maxStep. Contacts are not measured under domain
+// decomposition, where only the speed bound applies.
+struct AdaptiveStepSettings {
+  float courant = 0.25f;
+  float maxPenetration = 0.2f; // 0 ignores contacts
+  float minStep = 1.0f / 2000.0f;
+  float maxStep = 1.0f / 30.0f;
+  float growth = 1.25f; // Largest factor the step may grow by from one step to the next
+};
+
+// What decided the size of a step
+enum class StepLimit { Fixed, Requested, MaxStep, Growth, Speed, Penetration, MinStep };
+constexpr int stepLimitCount = 7;
+
+const char* stepLimitName(StepLimit limit);
+
+// Half-open run of body indices
+struct BodyRange {
+  size_t begin;
+  size_t end;
+};
+
+struct WorldStats {
+  uint64_t steps = 0;
+  uint64_t pairTests = 0; // Pairs handed to the narrowphase
+  uint64_t sweptBodies = 0; // Circles fast enough for continuous collision
+  uint64_t substeppedBodies = 0; // Circles stepped more than once per step by multi-rate stepping
+  double time = 0.0;        // Simulated seconds
+  float dt = 0.0f;          // Size of the last step
+  StepLimit dtLimit = StepLimit::Fixed;
+  uint64_t limitedSteps[stepLimitCount] = {}; // Steps taken per StepLimit
+};
+
+// Owns every circle in the simulation and advances them without touching OpenGL.
+class World {
+public:
+  World();
+
+  void addCircle(const Circle& circle);
+  // Swaps the last circle into index i
+  void removeCircle(size_t i);
+  void applyImpulse(size_t i, float impulseX, float impulseY);
+  void clear();
+
+  // Queues a change for the start of the next step. Safe from any thread, even while step runs,
+  // unlike every other mutator here. Returns false if the queue is full and the command was dropped.
+  bool submit(const Command& command) { return commands.push(command); }
+
+  // Applies queued commands, then advances every awake circle by dt
+  void step(float dt);
+  // Like step, with dt picked from AdaptiveStepSettings and no larger than limit, such as the time left
+  // in a frame. Returns the dt taken, which stats() also records along with what limited it.
+  float stepAdaptive(float limit = std::numeric_limits<float>::infinity());
+
+  void setAdaptiveStepSettings(const AdaptiveStepSettings& settings) { adaptiveConfig = settings; }
+  const AdaptiveStepSettings& adaptiveStepSettings() const { return adaptiveConfig; }
+
+  // Threads used by step, including the caller. 1 runs everything on the calling thread.
+  void setThreadCount(unsigned threads);
+  unsigned threadCount() const { return jobs ? jobs->size() : 1; }
+
+  // Splits collision work into this many spatial domains, one task each. 0 or 1 turns it off, and
+  // it only applies when there is more than one thread. Each domain runs its own uniform grid.
+  void setDomainCount(size_t count);
+  const DomainDecomposition* domainDecomposition() const { return usesDomains() ? &domains : nullptr; }
+
+  void setBroadphase(BroadphaseKind kind);
+  BroadphaseKind broadphaseKind() const { return broadphaseType; }
+
+  // Solves contacts iteratively with warm starting instead of one impulse each. Domain decomposition
+  // keeps the single impulse.
+  void setSolverSettings(const SolverSettings& settings) { solver.setSettings(settings); }
+  const SolverSettings& solverSettings() const { return solver.settings(); }
+  const ContactSolver& contactSolver() const { return solver; }
+
+  // Accelerates every circle each step. Without a field (the default) circles coast and the integrator
+  // choice makes no difference. Circles never fall asleep while a field is set.
+  void setForceField(std::unique_ptr<ForceField> field);
+  ForceField* forceField() const { return field.get(); }
+  void setIntegrator(IntegratorKind kind) { integrator.setKind(kind); }
+  IntegratorKind integratorKind() const { return integrator.kind(); }
+
+  // Sweeps circles that move more than a fraction of their radius in a step, so they bounce off
+  // whatever lies in their path instead of passing through it. On by default.
+  void setCcdSettings(const CcdSettings& settings) { ccdConfig = settings; }
+  const CcdSettings& ccdSettings() const { return ccdConfig; }
+
+  // Substeps only fast circles and whatever they can reach, leaving the rest on one step. A step that
+  // substeps anything skips the sweeps above, as substeps keep fast circles from skipping past others.
+  // Has no effect while a force field is set.
+  void setMultiRateSettings(const MultiRateSettings& settings) { multiRateConfig = settings; }
+  const MultiRateSettings& multiRateSettings() const { return multiRateConfig; }
+  const MultiRate& multiRate() const { return multiRateStepper; }
+
+  void setSleepSettings(const SleepSettings& settings);
+  const SleepSettings& sleepSettings() const { return sleepConfig; }
+  bool isAwake(size_t i) const { return awake[i] != 0; }
+  size_t sleepingCount() const { return sleepingBodies; }
+  void wakeAll();
+
+  // Appends the ids of every circle whose bounding box overlaps region
+  void queryRegion(const Aabb& region, std::vector<uint32_t>& out);
+
+  // Writes x/y for every circle into out, ready for the instance buffer. With alpha, positions are
+  // blended from the ones saved by storePreviousPositions towards the current ones.
+  void packInstances(std::vector<float>& out, float alpha = 1.0f) const;
+  void packInstances(float* out, float alpha = 1.0f) const;
+  // Like packInstances, but only rewrites circles that moved since the last call: awake ones and
+  // ones that fell asleep in between. ranges receives the runs written, for partial uploads.
+  void packInstanceRanges(float* out, float alpha, std::vector<BodyRange>& ranges);
+  // Writes the positions saved by storePreviousPositions for the given runs
+  void packPreviousInstances(float* out, const std::vector<BodyRange>& ranges) const;
+  void storePreviousPositions();
+
+  const CircleWorld& circles() const { return bodies; }
+  Circle circle(size_t i) const { return bodies.circle(i); }
+  size_t size() const { return bodies.size(); }
+  bool empty() const { return bodies.empty(); }
+
+  const WorldStats& stats() const { return worldStats; }
+  void resetStats() { worldStats = WorldStats{}; }
+
+private:
+  bool usesDomains() const { return jobs && domainsWanted > 1; }
+  void applyCommands();
+  void advance(float dt, StepLimit limit);
+  float fastestRate() const;
+  float deepestContact(const CandidatePair* pairs, size_t count) const;
+  void wakeBody(size_t i);
+  void resolveCollisions();
+  void integrate(float dt);
+  void buildStepGraph();
+  void packRange(float* out, size_t begin, size_t end, float alpha) const;
+
+  void collectWakes(const CandidatePair* contacts, size_t count, std::vector<uint32_t>& islands) const;
+  void wakeIslands(const std::vector<uint32_t>& islands);
+  size_t dropSleepingPairs(CandidatePair* contacts, size_t count) const;
+  void wakeTouched(std::vector<CandidatePair>& contacts);
+  void updateSleep(float dt);
+  uint32_t findIsland(uint32_t i);
+
+  CircleWorld bodies;
+  CommandQueue commands;
+  AlignedVector<float> previousX, previousY;
+  WorldStats worldStats;
+
+  SleepSettings sleepConfig;
+  std::vector<uint8_t> awake;
+  std::vector<uint8_t> staleInstance;  // Fell asleep after its last packInstanceRanges
+  AlignedVector<float> restTime;       // Seconds spent below the speed threshold
+  std::vector<uint32_t> islandOf;      // Island a sleeping body belongs to, named by one of its bodies
+  std::vector<uint32_t> islandParent;  // Union-find forest while islands are built
+  std::vector<float> islandRest;
+  std::vector<uint32_t> islandFirst;   // First sleeping body of each island, by island name
+  std::vector<uint32_t> islandNext;    // Next sleeping body in the same island
+  std::vector<uint32_t> pendingWakes;
+  std::vector<std::vector<uint32_t>> chunkWakes;
+  size_t sleepingBodies = 0;
+
+  BroadphaseKind broadphaseType = BroadphaseKind::UniformGrid;
+  std::unique_ptr<Broadphase> broadphase;
+  std::vector<CandidatePair> candidatePairs;
+  NarrowphaseScratch narrowphaseScratch;
+  ContactSolver solver;
+  std::unique_ptr<ForceField> field;
+  CcdSettings ccdConfig;
+  ContinuousCollision ccd;
+  MultiRateSettings multiRateConfig;
+  MultiRate multiRateStepper;
+  Integrator integrator;
+
+  AdaptiveStepSettings adaptiveConfig;
+  bool measureContacts = false; // Set while an adaptive step wants contactDepth
+  float contactDepth = 0.0f;    // Deepest contact found this step, as a fraction of the smaller radius
+  float lastStep = 0.0f;
+  float plannedStep = 0.0f; // Last adaptive step before it was capped at the caller's limit
+  mutable std::vector<float> threadRates;
+  std::vector<float> chunkDepths;
+
+  std::unique_ptr<JobSystem> jobs;
+  ParallelPipeline pipeline;
+  DomainDecomposition domains;
+  size_t domainsWanted = 0;
+  TaskGraph stepGraph; // Phases of a threaded step, see buildStepGraph
+  float stepDt = 0.0f;
+};
@@ -0,0 +1,286 @@
+#include "aabb_tree.h"
+#include "job_system.h"
+#include <algorithm>
+
+static Aabb combine(const Aabb& a, const Aabb& b) {
+  return Aabb{std::min(a.minX, b.minX), std::min(a.minY, b.minY), std::max(a.maxX, b.maxX), std::max(a.maxY, b.maxY)};
+}
+
+Aabb AabbTree::circleBox(const CircleWorld& circles, size_t i) {
+  float r = circles.radius[i];
+  return Aabb{circles.x[i] - r, circles.y[i] - r, circles.x[i] + r, circles.y[i] + r};
+}
+
+Aabb AabbTree::fatBox(const CircleWorld& circles, size_t i) const {
+  float r = circles.radius[i] * (1.0f + marginRatio);
+  return Aabb{circles.x[i] - r, circles.y[i] - r, circles.x[i] + r, circles.y[i] + r};
+}
+
+int AabbTree::allocateNode() {
+  int node;
+  if (freeList != nullNode) {
+    node = freeList;
+    freeList = nodes[node].parent;
+  }
+  else {
+    node = static_cast<int>(nodes.size());
+    nodes.emplace_back();
+  }
+  nodes[node] = Node{Aabb{}, nullNode, nullNode, nullNode, 0, 0};
+  return node;
+}
+
+void AabbTree::freeNode(int node) {
+  // Free nodes are chained through their parent field
+  nodes[node].parent = freeList;
+  nodes[node].height = -1;
+  freeList = node;
+}
+
+void AabbTree::clear() {
+  nodes.clear();
+  leafOf.clear();
+  root = nullNode;
+  freeList = nullNode;
+}
+
+void AabbTree::insertLeaf(int leaf) {
+  if (root == nullNode) {
+    root = leaf;
+    nodes[root].parent = nullNode;
+    return;
+  }
+
+  // Descend towards the sibling that grows the total perimeter the least
+  Aabb leafBox = nodes[leaf].box;
+  int index = root;
+  while (!nodes[index].isLeaf()) {
+    const Node& node = nodes[index];
+    float area = node.box.perimeter();
+    float combinedArea = combine(node.box, leafBox).perimeter();
+
+    // Cost of making a new parent for this node and the leaf
+    float cost = 2.0f * combinedArea;
+    // Minimum cost of pushing the leaf further down the tree
+    float inheritanceCost = 2.0f * (combinedArea - area);
+
+    auto descendCost = [&](int child) {
+      const Aabb& box = nodes[child].box;
+      float grown = combine(leafBox, box).perimeter();
+      if (nodes[child].isLeaf()) return grown + inheritanceCost;
+      return grown - box.perimeter() + inheritanceCost;
+    };
+    float cost1 = descendCost(node.child1);
+    float cost2 = descendCost(node.child2);
+
+    if (cost < cost1 && cost < cost2) break;
+    index = cost1 < cost2 ? node.child1 : node.child2;
+  }
+
+  int sibling = index;
+  int oldParent = nodes[sibling].parent;
+  int newParent = allocateNode();
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].box = combine(leafBox, nodes[sibling].box);
+  nodes[newParent].height = nodes[sibling].height + 1;
+  nodes[newParent].child1 = sibling;
+  nodes[newParent].child2 = leaf;
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+
+  if (oldParent == nullNode) {
+    root = newParent;
+  }
+  else if (nodes[oldParent].child1 == sibling) {
+    nodes[oldParent].child1 = newParent;
+  }
+  else {
+    nodes[oldParent].child2 = newParent;
+  }
+
+  fixUpwards(nodes[leaf].parent);
+}
+
+void AabbTree::removeLeaf(int leaf) {
+  if (leaf == root) {
+    root = nullNode;
+    return;
+  }
+
+  int parent = nodes[leaf].parent;
+  int grandParent = nodes[parent].parent;
+  int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+  if (grandParent == nullNode) {
+    root = sibling;
+    nodes[sibling].parent = nullNode;
+    freeNode(parent);
+    return;
+  }
+
+  if (nodes[grandParent].child1 == parent) nodes[grandParent].child1 = sibling;
+  else nodes[grandParent].child2 = sibling;
+  nodes[sibling].parent = grandParent;
+  freeNode(parent);
+
+  fixUpwards(grandParent);
+}
+
+// Rebalances and refits every ancestor from node up to the root
+void AabbTree::fixUpwards(int node) {
+  while (node != nullNode) {
+    node = balance(node);
+    Node& n = nodes[node];
+    n.height = 1 + std::max(nodes[n.child1].height, nodes[n.child2].height);
+    n.box = combine(nodes[n.child1].box, nodes[n.child2].box);
+    node = n.parent;
+  }
+}
+
+// If a's subtrees differ in height by more than one, rotate the taller child up. Returns the new subtree root.
+int AabbTree::balance(int a) {
+  if (nodes[a].isLeaf() || nodes[a].height < 2) return a;
+
+  int b = nodes[a].child1;
+  int c = nodes[a].child2;
+  int diff = nodes[c].height - nodes[b].height;
+  if (diff >= -1 && diff <= 1) return a;
+
+  // The taller child takes a's place; a keeps the shorter child plus the smaller grandchild
+  bool rotateC = diff > 1;
+  int up = rotateC ? c : b;
+  int stay = rotateC ? b : c;
+  int f = nodes[up].child1;
+  int g = nodes[up].child2;
+
+  nodes[up].child1 = a;
+  nodes[up].parent = nodes[a].parent;
+  nodes[a].parent = up;
+
+  int upParent = nodes[up].parent;
+  if (upParent == nullNode) root = up;
+  else if (nodes[upParent].child1 == a) nodes[upParent].child1 = up;
+  else nodes[upParent].child2 = up;
+
+  int keep = nodes[f].height > nodes[g].height ? f : g;
+  int give = keep == f ? g : f;
+  nodes[up].child2 = keep;
+  if (rotateC) nodes[a].child2 = give;
+  else nodes[a].child1 = give;
+  nodes[give].parent = a;
+
+  nodes[a].box = combine(nodes[stay].box, nodes[give].box);
+  nodes[a].height = 1 + std::max(nodes[stay].height, nodes[give].height);
+  nodes[up].box = combine(nodes[a].box, nodes[keep].box);
+  nodes[up].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+  return up;
+}
+
+// Leaves always cover circles 0 to leafOf.size() - 1, the ones added since the last update have none
+// yet. The top leaf belongs to last, unless last was added since. Either way it moves to slot i, and
+// update reinserts it if its fat box no longer holds the circle now there.
+void AabbTree::circleRemoved(uint32_t i, uint32_t) {
+  if (i >= leafOf.size()) return;
+  int leaf = leafOf[i];
+  removeLeaf(leaf);
+  freeNode(leaf);
+  int top = leafOf.back();
+  leafOf.pop_back();
+  if (i == leafOf.size()) return;
+  leafOf[i] = top;
+  nodes[top].body = i;
+}
+
+void AabbTree::update(const CircleWorld& circles) {
+  // Removals that were not reported leave ids that no longer line up, so the tree starts over
+  if (leafOf.size() > circles.size()) clear();
+
+  for (size_t i = 0; i < circles.size(); ++i) {
+    if (i < leafOf.size()) {
+      int leaf = leafOf[i];
+      if (nodes[leaf].box.contains(circleBox(circles, i))) continue;
+      removeLeaf(leaf);
+      nodes[leaf].box = fatBox(circles, i);
+      insertLeaf(leaf);
+      continue;
+    }
+
+    int leaf = allocateNode();
+    nodes[leaf].box = fatBox(circles, i);
+    nodes[leaf].body = static_cast<uint32_t>(i);
+    leafOf.push_back(leaf);
+    insertLeaf(leaf);
+  }
+}
+
+// Each circle's tight box against the fat boxes in the tree, keeping pairs whose tight boxes overlap
+void AabbTree::queryPairs(const CircleWorld& circles, size_t begin, size_t end, std::vector<int>& pending,
+                          std::vector<CandidatePair>& pairs) const {
+  for (size_t i = begin; i < end; ++i) {
+    uint32_t a = static_cast<uint32_t>(i);
+    Aabb box = circleBox(circles, i);
+
+    pending.clear();
+    pending.push_back(root);
+    while (!pending.empty()) {
+      const Node& node = nodes[pending.back()];
+      pending.pop_back();
+      if (!node.box.overlaps(box)) continue;
+
+      if (node.isLeaf()) {
+        if (node.body > a && circleBox(circles, node.body).overlaps(box)) {
+          pairs.push_back(CandidatePair{a, node.body});
+        }
+        continue;
+      }
+      pending.push_back(node.child1);
+      pending.push_back(node.child2);
+    }
+  }
+}
+
+void AabbTree::findPairs(const CircleWorld& circles, std::vector<CandidatePair>& pairs) {
+  pairs.clear();
+  update(circles);
+  if (root == nullNode) return;
+  queryPairs(circles, 0, circles.size(), stack, pairs);
+}
+
+// Refitting stays serial, queries only read the tree and run per range of circles
+void AabbTree::findPairsParallel(const CircleWorld& circles, JobSystem& jobs, std::vector<std::vector<CandidatePair>>& chunks) {
+  update(circles);
+  if (root == nullNode) {
+    chunks.clear();
+    return;
+  }
+
+  size_t chunkCount = jobs.size() * 4;
+  chunks.resize(chunkCount);
+  threadStacks.resize(jobs.size());
+  jobs.parallelFor(chunkCount, 1, [&](size_t begin, size_t end, unsigned thread) {
+    for (size_t chunk = begin; chunk < end; ++chunk) {
+      chunks[chunk].clear();
+      queryPairs(circles, chunk * circles.size() / chunkCount, (chunk + 1) * circles.size() / chunkCount,
+                 threadStacks[thread], chunks[chunk]);
+    }
+  });
+}
+
+void AabbTree::queryRegion(const Aabb& region, const CircleWorld& circles, std::vector<uint32_t>& out) const {
+  if (root == nullNode) return;
+
+  std::vector<int> pending;
+  pending.push_back(root);
+  while (!pending.empty()) {
+    const Node& node = nodes[pending.back()];
+    pending.pop_back();
+    if (!node.box.overlaps(region)) continue;
+
+    if (node.isLeaf()) {
+      if (circleBox(circles, node.body).overlaps(region)) out.push_back(node.body);
+      continue;
+    }
+    pending.push_back(node.child1);
+    pending.push_back(node.child2);
+  }
+}
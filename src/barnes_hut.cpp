@@ -0,0 +1,285 @@
+#include "barnes_hut.h"
+#include "job_system.h"
+#include <algorithm>
+#include <cmath>
+
+static constexpr int keyLevels = 16; // Bits per axis in a Morton key
+static constexpr uint32_t leafSize = 8;
+
+template <typename Body>
+static void forEachBlock(JobSystem* jobs, size_t count, size_t grain, Body body) {
+  if (jobs) jobs->parallelFor(count, grain, [&](size_t begin, size_t end, unsigned) { body(begin, end); });
+  else body(0, count);
+}
+
+// Spreads the low 16 bits of v to the even bits
+static uint32_t spreadBits(uint32_t v) {
+  v &= 0xffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// Quadrant of a key at a level: bit 0 is the x half, bit 1 the y half
+static uint32_t quadrantAt(uint32_t key, int level) {
+  return (key >> (2 * (keyLevels - 1 - level))) & 3;
+}
+
+void BarnesHutGravity::sortByKey(const float* x, const float* y, size_t n, JobSystem* jobs) {
+  // Bounding square of the circles, one extent per block reduced afterwards
+  size_t blocks = jobs ? std::min<size_t>(jobs->size() * 4, (n + 4095) / 4096) : 1;
+  blocks = std::max<size_t>(blocks, 1);
+  std::vector<float> extents(blocks * 4);
+  forEachBlock(jobs, blocks, 1, [&](size_t first, size_t last) {
+    for (size_t b = first; b < last; ++b) {
+      size_t begin = b * n / blocks;
+      size_t end = (b + 1) * n / blocks;
+      float minX = x[begin], minY = y[begin], maxX = x[begin], maxY = y[begin];
+      for (size_t i = begin; i < end; ++i) {
+        minX = std::min(minX, x[i]);
+        minY = std::min(minY, y[i]);
+        maxX = std::max(maxX, x[i]);
+        maxY = std::max(maxY, y[i]);
+      }
+      extents[4 * b] = minX;
+      extents[4 * b + 1] = minY;
+      extents[4 * b + 2] = maxX;
+      extents[4 * b + 3] = maxY;
+    }
+  });
+  float minX = extents[0], minY = extents[1], maxX = extents[2], maxY = extents[3];
+  for (size_t b = 1; b < blocks; ++b) {
+    minX = std::min(minX, extents[4 * b]);
+    minY = std::min(minY, extents[4 * b + 1]);
+    maxX = std::max(maxX, extents[4 * b + 2]);
+    maxY = std::max(maxY, extents[4 * b + 3]);
+  }
+
+  // Nudged outwards so the largest coordinate still maps inside the last cell
+  float size = std::max(std::max(maxX - minX, maxY - minY), 1e-6f) * 1.0001f;
+  rootSize = size;
+  float scale = static_cast<float>(1 << keyLevels) / size;
+
+  keys.resize(n);
+  order.resize(n);
+  forEachBlock(jobs, n, 16384, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      uint32_t kx = std::min(static_cast<uint32_t>((x[i] - minX) * scale), 0xffffu);
+      uint32_t ky = std::min(static_cast<uint32_t>((y[i] - minY) * scale), 0xffffu);
+      keys[i] = spreadBits(kx) | (spreadBits(ky) << 1);
+      order[i] = static_cast<uint32_t>(i);
+    }
+  });
+
+  // LSD radix sort, eight bits a pass. Each chunk counts its digits, the counts are turned into write
+  // offsets chunk by chunk, and chunks scatter in parallel, which keeps every pass stable.
+  scratchKeys.resize(n);
+  scratchOrder.resize(n);
+  size_t chunks = blocks;
+  histograms.resize(chunks);
+  for (int shift = 0; shift < 32; shift += 8) {
+    forEachBlock(jobs, chunks, 1, [&](size_t first, size_t last) {
+      for (size_t c = first; c < last; ++c) {
+        std::vector<uint32_t>& counts = histograms[c];
+        counts.assign(256, 0);
+        for (size_t i = c * n / chunks; i < (c + 1) * n / chunks; ++i) {
+          counts[(keys[i] >> shift) & 0xff]++;
+        }
+      }
+    });
+    uint32_t total = 0;
+    for (int digit = 0; digit < 256; ++digit) {
+      for (size_t c = 0; c < chunks; ++c) {
+        uint32_t count = histograms[c][digit];
+        histograms[c][digit] = total;
+        total += count;
+      }
+    }
+    forEachBlock(jobs, chunks, 1, [&](size_t first, size_t last) {
+      for (size_t c = first; c < last; ++c) {
+        std::vector<uint32_t>& cursor = histograms[c];
+        for (size_t i = c * n / chunks; i < (c + 1) * n / chunks; ++i) {
+          uint32_t slot = cursor[(keys[i] >> shift) & 0xff]++;
+          scratchKeys[slot] = keys[i];
+          scratchOrder[slot] = order[i];
+        }
+      }
+    });
+    keys.swap(scratchKeys);
+    order.swap(scratchOrder);
+  }
+}
+
+void BarnesHutGravity::accumulateLeaf(Node& node) const {
+  float mass = 0.0f, sumX = 0.0f, sumY = 0.0f;
+  for (uint32_t k = node.begin; k < node.end; ++k) {
+    mass += sortedMass[k];
+    sumX += sortedMass[k] * sortedX[k];
+    sumY += sortedMass[k] * sortedY[k];
+  }
+  node.mass = mass;
+  node.comX = mass > 0.0f ? sumX / mass : 0.0f;
+  node.comY = mass > 0.0f ? sumY / mass : 0.0f;
+}
+
+// Builds the cell holding sorted circles [begin, end) at level and returns its index in out. Children
+// are found by binary search, since sorted keys group each quadrant into one run.
+int32_t BarnesHutGravity::buildNode(std::vector<Node>& out, uint32_t begin, uint32_t end, int level, float size) const {
+  int32_t index = static_cast<int32_t>(out.size());
+  out.push_back(Node{0.0f, 0.0f, 0.0f, size, {-1, -1, -1, -1}, begin, end});
+  if (end - begin <= leafSize || level == keyLevels) {
+    accumulateLeaf(out[index]);
+    return index;
+  }
+
+  float mass = 0.0f, sumX = 0.0f, sumY = 0.0f;
+  uint32_t start = begin;
+  for (uint32_t q = 0; q < 4; ++q) {
+    uint32_t stop = static_cast<uint32_t>(std::partition_point(keys.begin() + start, keys.begin() + end,
+      [&](uint32_t key) { return quadrantAt(key, level) <= q; }) - keys.begin());
+    if (stop > start) {
+      int32_t child = buildNode(out, start, stop, level + 1, 0.5f * size);
+      out[index].child[q] = child;
+      mass += out[child].mass;
+      sumX += out[child].mass * out[child].comX;
+      sumY += out[child].mass * out[child].comY;
+    }
+    start = stop;
+  }
+  Node& node = out[index];
+  node.begin = node.end = 0;
+  node.mass = mass;
+  node.comX = mass > 0.0f ? sumX / mass : 0.0f;
+  node.comY = mass > 0.0f ? sumY / mass : 0.0f;
+  return index;
+}
+
+// Builds the top levels above the subtrees, copying each subtree in with its indices shifted
+int32_t BarnesHutGravity::linkTop(uint32_t cell, int level, float size) {
+  if (level == topLevels) {
+    Subtree& subtree = subtrees[cell];
+    if (subtree.nodes.empty()) return -1;
+    int32_t offset = static_cast<int32_t>(nodes.size());
+    for (Node node : subtree.nodes) {
+      for (int32_t& child : node.child) {
+        if (child >= 0) child += offset;
+      }
+      nodes.push_back(node);
+    }
+    return offset;
+  }
+
+  int32_t index = static_cast<int32_t>(nodes.size());
+  nodes.push_back(Node{0.0f, 0.0f, 0.0f, size, {-1, -1, -1, -1}, 0, 0});
+  float mass = 0.0f, sumX = 0.0f, sumY = 0.0f;
+  for (uint32_t q = 0; q < 4; ++q) {
+    int32_t child = linkTop(cell * 4 + q, level + 1, 0.5f * size);
+    if (child < 0) continue;
+    nodes[index].child[q] = child;
+    mass += nodes[child].mass;
+    sumX += nodes[child].mass * nodes[child].comX;
+    sumY += nodes[child].mass * nodes[child].comY;
+  }
+  if (mass == 0.0f && level > 0) {
+    nodes.pop_back();
+    return -1;
+  }
+  Node& node = nodes[index];
+  node.mass = mass;
+  node.comX = mass > 0.0f ? sumX / mass : 0.0f;
+  node.comY = mass > 0.0f ? sumY / mass : 0.0f;
+  return index;
+}
+
+void BarnesHutGravity::accelerations(const CircleWorld& bodies, const float* x, const float* y, float* ax, float* ay,
+                                     JobSystem* jobs) {
+  size_t n = bodies.size();
+  nodes.clear();
+  if (n == 0) return;
+
+  sortByKey(x, y, n, jobs);
+  sortedX.resize(n);
+  sortedY.resize(n);
+  sortedMass.resize(n);
+  forEachBlock(jobs, n, 16384, [&](size_t begin, size_t end) {
+    for (size_t k = begin; k < end; ++k) {
+      uint32_t i = order[k];
+      sortedX[k] = x[i];
+      sortedY[k] = y[i];
+      sortedMass[k] = 1.0f / bodies.invMass[i];
+    }
+  });
+
+  // Enough top cells to keep every thread busy, none for small or single threaded runs
+  topLevels = 0;
+  if (jobs && n >= 4096) {
+    while (topLevels < 4 && (size_t(1) << (2 * topLevels)) < jobs->size() * 8) ++topLevels;
+  }
+  uint32_t cells = 1u << (2 * topLevels);
+  subtrees.resize(cells);
+  int shift = 2 * (keyLevels - topLevels);
+  for (uint32_t c = 0; c < cells; ++c) {
+    uint64_t low = uint64_t(c) << shift;
+    uint64_t high = uint64_t(c + 1) << shift;
+    Subtree& subtree = subtrees[c];
+    subtree.begin = static_cast<uint32_t>(std::lower_bound(keys.begin(), keys.end(), low) - keys.begin());
+    subtree.end = static_cast<uint32_t>(std::lower_bound(keys.begin(), keys.end(), high) - keys.begin());
+    subtree.size = rootSize / static_cast<float>(1 << topLevels);
+  }
+  forEachBlock(jobs, cells, 1, [&](size_t first, size_t last) {
+    for (size_t c = first; c < last; ++c) {
+      Subtree& subtree = subtrees[c];
+      subtree.nodes.clear();
+      if (subtree.end > subtree.begin) buildNode(subtree.nodes, subtree.begin, subtree.end, topLevels, subtree.size);
+    }
+  });
+  linkTop(0, 0, rootSize);
+
+  // Circles are visited in key order, so neighbouring threads walk neighbouring parts of the tree
+  float softSq = softening * softening;
+  float thetaSq = theta * theta;
+  forEachBlock(jobs, n, 256, [&](size_t begin, size_t end) {
+    int32_t stack[4 * keyLevels + 8];
+    for (size_t k = begin; k < end; ++k) {
+      float px = sortedX[k];
+      float py = sortedY[k];
+      float sumX = 0.0f;
+      float sumY = 0.0f;
+      int top = 0;
+      stack[top++] = 0;
+      while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        float dx = node.comX - px;
+        float dy = node.comY - py;
+        float distSq = dx * dx + dy * dy;
+        if (node.size * node.size < thetaSq * distSq) {
+          // Far enough to act as one mass
+          float d2 = distSq + softSq;
+          float pull = node.mass / (d2 * std::sqrt(d2));
+          sumX += dx * pull;
+          sumY += dy * pull;
+        }
+        else if (node.begin < node.end) {
+          for (uint32_t j = node.begin; j < node.end; ++j) {
+            float ox = sortedX[j] - px;
+            float oy = sortedY[j] - py;
+            float d2 = ox * ox + oy * oy + softSq;
+            float pull = sortedMass[j] / (d2 * std::sqrt(d2));
+            sumX += ox * pull;
+            sumY += oy * pull;
+          }
+        }
+        else {
+          for (int32_t child : node.child) {
+            if (child >= 0) stack[top++] = child;
+          }
+        }
+      }
+      uint32_t i = order[k];
+      ax[i] = strength * sumX;
+      ay[i] = strength * sumY;
+    }
+  });
+}
@@ -0,0 +1,38 @@
+#include "broadphase.h"
+#include "aabb_tree.h"
+#include "sweep_and_prune.h"
+#include "uniform_grid.h"
+
+void Broadphase::findPairsParallel(const CircleWorld& circles, JobSystem&, std::vector<std::vector<CandidatePair>>& chunks) {
+  chunks.resize(1);
+  findPairs(circles, chunks[0]);
+}
+
+std::unique_ptr<Broadphase> createBroadphase(BroadphaseKind kind) {
+  switch (kind) {
+    case BroadphaseKind::UniformGrid: return std::make_unique<UniformGrid>();
+    case BroadphaseKind::SweepAndPrune: return std::make_unique<SweepAndPrune>();
+    case BroadphaseKind::AabbTree: return std::make_unique<AabbTree>();
+    case BroadphaseKind::BruteForce: break;
+  }
+  return nullptr;
+}
+
+const char* broadphaseName(BroadphaseKind kind) {
+  switch (kind) {
+    case BroadphaseKind::BruteForce: return "brute";
+    case BroadphaseKind::UniformGrid: return "grid";
+    case BroadphaseKind::SweepAndPrune: return "sap";
+    case BroadphaseKind::AabbTree: return "tree";
+  }
+  return "unknown";
+}
+
+bool parseBroadphaseKind(const std::string& name, BroadphaseKind& kind) {
+  if (name == "brute") kind = BroadphaseKind::BruteForce;
+  else if (name == "grid") kind = BroadphaseKind::UniformGrid;
+  else if (name == "sap") kind = BroadphaseKind::SweepAndPrune;
+  else if (name == "tree") kind = BroadphaseKind::AabbTree;
+  else return false;
+  return true;
+}
@@ -1,4 +1,5 @@
 #include "circle.h"
+#include "force_field.h"
 #include <cmath>
 
 float Circle::distanceTo(const Circle& other) const {
@@ -7,6 +8,44 @@ float Circle::distanceTo(const Circle& other) const {
   return std::sqrt(dx * dx + dy * dy);
 }
 
+// Same softened gravity as PairwiseGravity, felt by self at (px, py)
+static void gravityAt(const Circle& self, float px, float py, const std::vector<Circle>& others, float& ax, float& ay) {
+  float softSq = defaultGravitySoftening * defaultGravitySoftening;
+  ax = 0.0f;
+  ay = 0.0f;
+  for (const Circle& other : others) {
+    if (&other == &self) continue;
+    float dx = other.x - px;
+    float dy = other.y - py;
+    float distSq = dx * dx + dy * dy + softSq;
+    float pull = defaultGravityStrength * other.mass / (distSq * std::sqrt(distSq));
+    ax += dx * pull;
+    ay += dy * pull;
+  }
+}
+
+void Circle::updateRK4(float dt, const std::vector<Circle>& others) {
+  float ax1, ay1, ax2, ay2, ax3, ay3, ax4, ay4;
+  gravityAt(*this, x, y, others, ax1, ay1);
+
+  float vx2 = vx + 0.5f * dt * ax1;
+  float vy2 = vy + 0.5f * dt * ay1;
+  gravityAt(*this, x + 0.5f * dt * vx, y + 0.5f * dt * vy, others, ax2, ay2);
+
+  float vx3 = vx + 0.5f * dt * ax2;
+  float vy3 = vy + 0.5f * dt * ay2;
+  gravityAt(*this, x + 0.5f * dt * vx2, y + 0.5f * dt * vy2, others, ax3, ay3);
+
+  float vx4 = vx + dt * ax3;
+  float vy4 = vy + dt * ay3;
+  gravityAt(*this, x + dt * vx3, y + dt * vy3, others, ax4, ay4);
+
+  x += dt / 6.0f * (vx + 2.0f * vx2 + 2.0f * vx3 + vx4);
+  y += dt / 6.0f * (vy + 2.0f * vy2 + 2.0f * vy3 + vy4);
+  vx += dt / 6.0f * (ax1 + 2.0f * ax2 + 2.0f * ax3 + ax4);
+  vy += dt / 6.0f * (ay1 + 2.0f * ay2 + 2.0f * ay3 + ay4);
+}
+
 void Circle::applyCollision(Circle& other) {
   float dist = distanceTo(other);
   float minDist = radius + other.radius;
@@ -0,0 +1,52 @@
+#include "circle_world.h"
+
+void CircleWorld::add(const Circle& circle) {
+  x.push_back(circle.x);
+  y.push_back(circle.y);
+  vx.push_back(circle.vx);
+  vy.push_back(circle.vy);
+  radius.push_back(circle.radius);
+  invMass.push_back(1.0f / circle.mass);
+}
+
+void CircleWorld::remove(size_t i) {
+  size_t last = size() - 1;
+  setCircle(i, circle(last));
+  x.pop_back();
+  y.pop_back();
+  vx.pop_back();
+  vy.pop_back();
+  radius.pop_back();
+  invMass.pop_back();
+}
+
+void CircleWorld::clear() {
+  x.clear();
+  y.clear();
+  vx.clear();
+  vy.clear();
+  radius.clear();
+  invMass.clear();
+}
+
+void CircleWorld::reserve(size_t count) {
+  x.reserve(count);
+  y.reserve(count);
+  vx.reserve(count);
+  vy.reserve(count);
+  radius.reserve(count);
+  invMass.reserve(count);
+}
+
+Circle CircleWorld::circle(size_t i) const {
+  return Circle(x[i], y[i], vx[i], vy[i], radius[i], 1.0f / invMass[i]);
+}
+
+void CircleWorld::setCircle(size_t i, const Circle& circle) {
+  x[i] = circle.x;
+  y[i] = circle.y;
+  vx[i] = circle.vx;
+  vy[i] = circle.vy;
+  radius[i] = circle.radius;
+  invMass[i] = 1.0f / circle.mass;
+}
@@ -0,0 +1,83 @@
+#include "command_queue.h"
+
+Command Command::spawn(const Circle& circle) {
+  Command command;
+  command.type = Type::Spawn;
+  command.x = circle.x;
+  command.y = circle.y;
+  command.vx = circle.vx;
+  command.vy = circle.vy;
+  command.radius = circle.radius;
+  command.mass = circle.mass;
+  return command;
+}
+
+Command Command::remove(uint32_t body) {
+  Command command;
+  command.type = Type::Remove;
+  command.body = body;
+  return command;
+}
+
+Command Command::impulse(uint32_t body, float impulseX, float impulseY) {
+  Command command;
+  command.type = Type::Impulse;
+  command.body = body;
+  command.impulseX = impulseX;
+  command.impulseY = impulseY;
+  return command;
+}
+
+Command Command::reset() {
+  return Command{};
+}
+
+Command Command::setBroadphase(BroadphaseKind kind) {
+  Command command;
+  command.type = Type::SetBroadphase;
+  command.broadphase = kind;
+  return command;
+}
+
+CommandQueue::CommandQueue(size_t capacity) {
+  size_t size = 2;
+  while (size < capacity) size *= 2;
+  mask = size - 1;
+  slots.reset(new Slot[size]);
+  for (size_t i = 0; i < size; ++i) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+bool CommandQueue::push(const Command& command) {
+  size_t position = tail.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot& slot = slots[position & mask];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    // The slot is free for this lap when its sequence matches the position
+    if (sequence == position) {
+      if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        slot.command = command;
+        slot.sequence.store(position + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if (sequence < position) {
+      // Still holds a command from the previous lap
+      return false;
+    }
+    else {
+      position = tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool CommandQueue::pop(Command& command) {
+  Slot& slot = slots[head & mask];
+  if (slot.sequence.load(std::memory_order_acquire) != head + 1) return false;
+  command = slot.command;
+  // Free the slot for the producer one lap ahead
+  slot.sequence.store(head + mask + 1, std::memory_order_release);
+  head++;
+  return true;
+}
@@ -0,0 +1,186 @@
+#include "contact_solver.h"
+#include "job_system.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+static constexpr uint64_t emptyKey = ~uint64_t(0);
+
+// Same key whichever way round the pair comes out of the broadphase
+static uint64_t pairKey(uint32_t a, uint32_t b) {
+  if (a > b) std::swap(a, b);
+  return (uint64_t(a) << 32) | b;
+}
+
+static size_t slotOf(uint64_t key, size_t mask) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  return static_cast<size_t>(key) & mask;
+}
+
+void ContactSolver::solve(CircleWorld& bodies, const CandidatePair* contacts, size_t count) {
+  size_t batchStart[2] = {0, count};
+  run(bodies, contacts, count, batchStart, 0, nullptr);
+}
+
+void ContactSolver::solveBatches(CircleWorld& bodies, const CandidatePair* contacts, const size_t* batchStart,
+                                 size_t batches, JobSystem& jobs) {
+  run(bodies, contacts, batchStart[batches + 1], batchStart, batches, &jobs);
+}
+
+void ContactSolver::clearCache() {
+  cache.clear();
+  nextCache.clear();
+}
+
+void ContactSolver::run(CircleWorld& bodies, const CandidatePair* contacts, size_t count, const size_t* batchStart,
+                        size_t batches, JobSystem* jobs) {
+  constraints.resize(count);
+  std::atomic<size_t> started{0};
+  auto prepareRange = [&](size_t begin, size_t end, unsigned) {
+    prepare(bodies, contacts, begin, end);
+    size_t warm = 0;
+    for (size_t i = begin; i < end; ++i) {
+      warm += constraints[i].impulse > 0.0f;
+    }
+    started.fetch_add(warm, std::memory_order_relaxed);
+  };
+  if (jobs) jobs->parallelFor(count, 4096, prepareRange);
+  else prepareRange(0, count, 0);
+  warmStarted = started.load();
+
+  // Every pass walks the batches in order. Contacts inside a batch share no body, so their slices can
+  // run on different threads; the overflow batch runs on this one.
+  auto forEachBatch = [&](auto&& pass) {
+    for (size_t k = 0; k < batches; ++k) {
+      size_t first = batchStart[k];
+      size_t last = batchStart[k + 1];
+      if (first == last) continue;
+      jobs->parallelFor(last - first, 1024, [&](size_t begin, size_t end, unsigned) {
+        pass(first + begin, first + end);
+      });
+    }
+    pass(batchStart[batches], batchStart[batches + 1]);
+  };
+
+  if (config.warmStarting && warmStarted > 0) {
+    forEachBatch([&](size_t begin, size_t end) { warmStart(bodies, begin, end); });
+  }
+  for (unsigned iteration = 0; iteration < config.iterations; ++iteration) {
+    forEachBatch([&](size_t begin, size_t end) { solveVelocities(bodies, begin, end); });
+  }
+  forEachBatch([&](size_t begin, size_t end) { solvePositions(bodies, begin, end); });
+  storeImpulses();
+}
+
+void ContactSolver::prepare(const CircleWorld& bodies, const CandidatePair* contacts, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    uint32_t a = contacts[i].a;
+    uint32_t b = contacts[i].b;
+    Constraint& c = constraints[i];
+    c.a = a;
+    c.b = b;
+
+    float dx = bodies.x[a] - bodies.x[b];
+    float dy = bodies.y[a] - bodies.y[b];
+    float dist = std::sqrt(dx * dx + dy * dy);
+    float invMassSum = bodies.invMass[a] + bodies.invMass[b];
+    if (dist <= 0.0f || invMassSum <= 0.0f) {
+      // Nothing to push along, the constraint stays inert
+      c.nx = 0.0f;
+      c.ny = 0.0f;
+      c.normalMass = 0.0f;
+      c.velocityTarget = 0.0f;
+      c.impulse = 0.0f;
+      continue;
+    }
+    c.nx = dx / dist;
+    c.ny = dy / dist;
+    c.normalMass = 1.0f / invMassSum;
+
+    // Restitution is decided on the approach speed before any impulse this step
+    float approach = (bodies.vx[a] - bodies.vx[b]) * c.nx + (bodies.vy[a] - bodies.vy[b]) * c.ny;
+    c.velocityTarget = -approach > config.restitutionThreshold ? -config.restitution * approach : 0.0f;
+    c.impulse = config.warmStarting ? cachedImpulse(pairKey(a, b)) : 0.0f;
+  }
+}
+
+void ContactSolver::warmStart(CircleWorld& bodies, size_t begin, size_t end) const {
+  for (size_t i = begin; i < end; ++i) {
+    const Constraint& c = constraints[i];
+    if (c.impulse == 0.0f) continue;
+    float px = c.impulse * c.nx;
+    float py = c.impulse * c.ny;
+    bodies.vx[c.a] += px * bodies.invMass[c.a];
+    bodies.vy[c.a] += py * bodies.invMass[c.a];
+    bodies.vx[c.b] -= px * bodies.invMass[c.b];
+    bodies.vy[c.b] -= py * bodies.invMass[c.b];
+  }
+}
+
+void ContactSolver::solveVelocities(CircleWorld& bodies, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    Constraint& c = constraints[i];
+    float relative = (bodies.vx[c.a] - bodies.vx[c.b]) * c.nx + (bodies.vy[c.a] - bodies.vy[c.b]) * c.ny;
+    float lambda = (c.velocityTarget - relative) * c.normalMass;
+
+    // Clamp the total rather than this pass's share, so later passes can take back too much push
+    float total = std::max(c.impulse + lambda, 0.0f);
+    lambda = total - c.impulse;
+    c.impulse = total;
+
+    float px = lambda * c.nx;
+    float py = lambda * c.ny;
+    bodies.vx[c.a] += px * bodies.invMass[c.a];
+    bodies.vy[c.a] += py * bodies.invMass[c.a];
+    bodies.vx[c.b] -= px * bodies.invMass[c.b];
+    bodies.vy[c.b] -= py * bodies.invMass[c.b];
+  }
+}
+
+// Overlap fixer on current positions, split by inverse mass
+void ContactSolver::solvePositions(CircleWorld& bodies, size_t begin, size_t end) const {
+  for (size_t i = begin; i < end; ++i) {
+    const Constraint& c = constraints[i];
+    if (c.normalMass == 0.0f) continue;
+    float dx = bodies.x[c.a] - bodies.x[c.b];
+    float dy = bodies.y[c.a] - bodies.y[c.b];
+    float distSq = dx * dx + dy * dy;
+    float minDist = bodies.radius[c.a] + bodies.radius[c.b];
+    if (distSq >= minDist * minDist || distSq <= 0.0f) continue;
+
+    float dist = std::sqrt(distSq);
+    float push = config.correction * std::max(minDist - dist - config.slop, 0.0f) * c.normalMass / dist;
+    bodies.x[c.a] += dx * push * bodies.invMass[c.a];
+    bodies.y[c.a] += dy * push * bodies.invMass[c.a];
+    bodies.x[c.b] -= dx * push * bodies.invMass[c.b];
+    bodies.y[c.b] -= dy * push * bodies.invMass[c.b];
+  }
+}
+
+// Rebuilds the table from this step's contacts. Only contacts still pushing are kept, at most half full.
+void ContactSolver::storeImpulses() {
+  size_t capacity = 16;
+  while (capacity < constraints.size() * 2) capacity *= 2;
+  nextCache.assign(capacity, CachedImpulse{emptyKey, 0.0f});
+
+  size_t mask = capacity - 1;
+  for (const Constraint& c : constraints) {
+    if (c.impulse <= 0.0f) continue;
+    uint64_t key = pairKey(c.a, c.b);
+    size_t slot = slotOf(key, mask);
+    while (nextCache[slot].key != emptyKey && nextCache[slot].key != key) slot = (slot + 1) & mask;
+    nextCache[slot] = CachedImpulse{key, c.impulse};
+  }
+  cache.swap(nextCache);
+}
+
+float ContactSolver::cachedImpulse(uint64_t key) const {
+  if (cache.empty()) return 0.0f;
+  size_t mask = cache.size() - 1;
+  for (size_t slot = slotOf(key, mask); cache[slot].key != emptyKey; slot = (slot + 1) & mask) {
+    if (cache[slot].key == key) return cache[slot].impulse;
+  }
+  return 0.0f;
+}
@@ -0,0 +1,230 @@
+#include "continuous_collision.h"
+#include "job_system.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+static constexpr float never = std::numeric_limits<float>::infinity();
+
+// Earliest time after from at which a and b, each following x + v * t, close to touching distance.
+// Pairs already touching belong to the narrowphase and never report an impact.
+static float impactTime(const CircleWorld& bodies, uint32_t a, uint32_t b, float from) {
+  float wx = bodies.vx[a] - bodies.vx[b];
+  float wy = bodies.vy[a] - bodies.vy[b];
+  float dx = (bodies.x[a] + bodies.vx[a] * from) - (bodies.x[b] + bodies.vx[b] * from);
+  float dy = (bodies.y[a] + bodies.vy[a] * from) - (bodies.y[b] + bodies.vy[b] * from);
+  float closing = dx * wx + dy * wy;
+  if (closing >= 0.0f) return never;
+
+  float reach = bodies.radius[a] + bodies.radius[b];
+  float gap = dx * dx + dy * dy - reach * reach;
+  if (gap <= 0.0f) return never;
+  float disc = closing * closing - (wx * wx + wy * wy) * gap;
+  if (disc < 0.0f) return never;
+  // Smaller root of |d + w s|² = reach², in the form that stays accurate for small s
+  return from + gap / (std::sqrt(disc) - closing);
+}
+
+// Time from now until a circle at p moving at v reaches the wall it is heading for
+static float wallTime(float p, float v, float radius, float minBound, float maxBound) {
+  if (v < 0.0f && p - radius > minBound) return (minBound + radius - p) / v;
+  if (v > 0.0f && p + radius < maxBound) return (maxBound - radius - p) / v;
+  return never;
+}
+
+bool ContinuousCollision::isFast(const CircleWorld& bodies, size_t i, float dt, float threshold) const {
+  float reach = threshold * bodies.radius[i];
+  float speedSq = bodies.vx[i] * bodies.vx[i] + bodies.vy[i] * bodies.vy[i];
+  return speedSq * dt * dt > reach * reach;
+}
+
+size_t ContinuousCollision::sweep(CircleWorld& bodies, float dt, float minBound, float maxBound,
+                                  const CcdSettings& settings, JobSystem* jobs) {
+  hits.clear();
+  size_t n = bodies.size();
+  if (!settings.enabled || n == 0) return 0;
+
+  float threshold = settings.motionThreshold;
+  std::atomic<bool> anyFast{false};
+  auto scan = [&](size_t begin, size_t end, unsigned) {
+    bool found = false;
+    for (size_t i = begin; i < end; ++i) {
+      found |= isFast(bodies, i, dt, threshold);
+    }
+    if (found) anyFast.store(true, std::memory_order_relaxed);
+  };
+  if (jobs) jobs->parallelFor(n, 16384, scan);
+  else scan(0, n, 0);
+  if (!anyFast.load()) return 0;
+
+  moving.assign(n, 0);
+  eventTime.assign(n, 0.0f);
+  movers.clear();
+  for (size_t i = 0; i < n; ++i) {
+    if (!isFast(bodies, i, dt, threshold)) continue;
+    moving[i] = 1;
+    movers.push_back(static_cast<uint32_t>(i));
+  }
+  buildGrid(bodies, dt, minBound, maxBound);
+
+  // Circles knocked fast by a swept one join the end of the list, starting from the impact
+  for (size_t m = 0; m < movers.size(); ++m) {
+    uint32_t i = movers[m];
+    for (int impact = 0; impact < settings.maxImpacts; ++impact) {
+      float t = eventTime[i];
+      float r = bodies.radius[i];
+      float px = bodies.x[i] + bodies.vx[i] * t;
+      float py = bodies.y[i] + bodies.vy[i] * t;
+      float first = dt;
+      int wall = -1;
+      uint32_t other = 0;
+
+      float wallX = t + wallTime(px, bodies.vx[i], r, minBound, maxBound);
+      float wallY = t + wallTime(py, bodies.vy[i], r, minBound, maxBound);
+      if (wallX < first) {
+        first = wallX;
+        wall = 0;
+      }
+      if (wallY < first) {
+        first = wallY;
+        wall = 1;
+      }
+
+      // Everything whose swept box meets the rest of this one, each circle once
+      float endX = bodies.x[i] + bodies.vx[i] * dt;
+      float endY = bodies.y[i] + bodies.vy[i] * dt;
+      int cx0, cx1, cy0, cy1;
+      cellRange(std::min(px, endX) - r, std::max(px, endX) + r, cx0, cx1);
+      cellRange(std::min(py, endY) - r, std::max(py, endY) + r, cy0, cy1);
+      if (++query == 0) {
+        std::fill(seen.begin(), seen.end(), 0);
+        query = 1;
+      }
+      seen[i] = query;
+      auto consider = [&](uint32_t j) {
+        if (seen[j] == query) return;
+        seen[j] = query;
+        float time = impactTime(bodies, i, j, std::max(t, eventTime[j]));
+        if (time < first) {
+          first = time;
+          wall = -1;
+          other = j;
+        }
+      };
+      for (int cy = cy0; cy <= cy1; ++cy) {
+        for (int cx = cx0; cx <= cx1; ++cx) {
+          size_t c = static_cast<size_t>(cy) * cols + cx;
+          for (uint32_t e = cellStart[c]; e < cellStart[c + 1]; ++e) {
+            consider(cellEntries[e]);
+          }
+        }
+      }
+      for (uint32_t j : oversized) {
+        consider(j);
+      }
+      if (first >= dt) break;
+
+      if (wall == 0) {
+        bodies.x[i] += 2.0f * bodies.vx[i] * first;
+        bodies.vx[i] = -bodies.vx[i];
+      }
+      else if (wall == 1) {
+        bodies.y[i] += 2.0f * bodies.vy[i] * first;
+        bodies.vy[i] = -bodies.vy[i];
+      }
+      else {
+        bounce(bodies, i, other, first);
+        eventTime[other] = first;
+        hits.push_back(CandidatePair{std::min(i, other), std::max(i, other)});
+        if (!moving[other] && isFast(bodies, other, dt, threshold)) {
+          moving[other] = 1;
+          movers.push_back(other);
+        }
+      }
+      eventTime[i] = first;
+    }
+  }
+  return movers.size();
+}
+
+void ContinuousCollision::cellRange(float lo, float hi, int& first, int& last) const {
+  first = std::clamp(static_cast<int>(std::floor((lo - gridMin) / cell)), 0, cols - 1);
+  last = std::clamp(static_cast<int>(std::floor((hi - gridMin) / cell)), 0, cols - 1);
+}
+
+void ContinuousCollision::buildGrid(const CircleWorld& bodies, float dt, float minBound, float maxBound) {
+  size_t n = bodies.size();
+  float maxRadius = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    maxRadius = std::max(maxRadius, bodies.radius[i]);
+  }
+
+  // Cells one diameter wide, as long as the cell count stays linear in the circle count
+  float span = maxBound - minBound;
+  gridMin = minBound;
+  cols = std::max(1, static_cast<int>(span / std::max(2.0f * maxRadius, 1e-6f)));
+  cols = std::min(cols, static_cast<int>(std::sqrt(static_cast<double>(n) * 4.0)) + 1);
+  cell = span / static_cast<float>(cols);
+
+  // Two passes over the swept boxes: count the entries of each cell, then place them
+  const int maxCells = 64;
+  size_t cellCount = static_cast<size_t>(cols) * cols;
+  cellStart.assign(cellCount + 1, 0);
+  oversized.clear();
+  auto forEachCell = [&](size_t i, auto&& visit) {
+    float r = bodies.radius[i];
+    float endX = bodies.x[i] + bodies.vx[i] * dt;
+    float endY = bodies.y[i] + bodies.vy[i] * dt;
+    int cx0, cx1, cy0, cy1;
+    cellRange(std::min(bodies.x[i], endX) - r, std::max(bodies.x[i], endX) + r, cx0, cx1);
+    cellRange(std::min(bodies.y[i], endY) - r, std::max(bodies.y[i], endY) + r, cy0, cy1);
+    if ((cx1 - cx0 + 1) * (cy1 - cy0 + 1) > maxCells) return false;
+    for (int cy = cy0; cy <= cy1; ++cy) {
+      for (int cx = cx0; cx <= cx1; ++cx) {
+        visit(static_cast<size_t>(cy) * cols + cx);
+      }
+    }
+    return true;
+  };
+
+  for (size_t i = 0; i < n; ++i) {
+    if (!forEachCell(i, [&](size_t c) { cellStart[c + 1]++; })) oversized.push_back(static_cast<uint32_t>(i));
+  }
+  for (size_t c = 0; c < cellCount; ++c) {
+    cellStart[c + 1] += cellStart[c];
+  }
+  cellEntries.resize(cellStart[cellCount]);
+  cursor.assign(cellStart.begin(), cellStart.end() - 1);
+  for (size_t i = 0; i < n; ++i) {
+    forEachCell(i, [&](size_t c) { cellEntries[cursor[c]++] = static_cast<uint32_t>(i); });
+  }
+  seen.resize(n, 0);
+}
+
+// Elastic impulse at the moment a and b touch, with both start positions shifted to keep them on
+// their bounced paths from then on
+void ContinuousCollision::bounce(CircleWorld& bodies, uint32_t a, uint32_t b, float t) {
+  float dx = (bodies.x[a] + bodies.vx[a] * t) - (bodies.x[b] + bodies.vx[b] * t);
+  float dy = (bodies.y[a] + bodies.vy[a] * t) - (bodies.y[b] + bodies.vy[b] * t);
+  float dist = std::sqrt(dx * dx + dy * dy);
+  if (dist <= 0.0f) return;
+  float nx = dx / dist;
+  float ny = dy / dist;
+  float relDot = (bodies.vx[a] - bodies.vx[b]) * nx + (bodies.vy[a] - bodies.vy[b]) * ny;
+  if (relDot >= 0.0f) return;
+
+  float impulse = (2 * relDot) / (bodies.invMass[a] + bodies.invMass[b]);
+  float dvxA = -impulse * bodies.invMass[a] * nx;
+  float dvyA = -impulse * bodies.invMass[a] * ny;
+  float dvxB = impulse * bodies.invMass[b] * nx;
+  float dvyB = impulse * bodies.invMass[b] * ny;
+  bodies.x[a] -= dvxA * t;
+  bodies.y[a] -= dvyA * t;
+  bodies.vx[a] += dvxA;
+  bodies.vy[a] += dvyA;
+  bodies.x[b] -= dvxB * t;
+  bodies.y[b] -= dvyB * t;
+  bodies.vx[b] += dvxB;
+  bodies.vy[b] += dvyB;
+}
@@ -0,0 +1,274 @@
+#include "domain_decomposition.h"
+#include "job_system.h"
+#include "kernels.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+static constexpr float infinity = std::numeric_limits<float>::infinity();
+
+void DomainDecomposition::setDomainCount(size_t count) {
+  count = std::max<size_t>(count, 1);
+  if (count == domains.size()) return;
+  domains.clear();
+  domains.resize(count);
+  bounds.clear();
+  assigned = false;
+}
+
+std::vector<float> DomainDecomposition::borders() const {
+  if (bounds.size() < 2) return {};
+  return std::vector<float>(bounds.begin() + 1, bounds.end() - 1);
+}
+
+double DomainDecomposition::imbalance() const {
+  double total = 0.0;
+  double slowest = 0.0;
+  for (const Domain& domain : domains) {
+    total += domain.cost;
+    slowest = std::max(slowest, domain.cost);
+  }
+  return total > 0.0 ? slowest * static_cast<double>(domains.size()) / total : 1.0;
+}
+
+size_t DomainDecomposition::domainOf(float x) const {
+  return static_cast<size_t>(std::upper_bound(bounds.begin() + 1, bounds.end() - 1, x) - (bounds.begin() + 1));
+}
+
+// Even strips over the circles' extent, every circle handed to the strip it sits in
+void DomainDecomposition::assignAll(const CircleWorld& bodies) {
+  size_t count = domains.size();
+  float minX = infinity, maxX = -infinity, maxRadius = 0.0f;
+  for (size_t i = 0; i < bodies.size(); ++i) {
+    minX = std::min(minX, bodies.x[i]);
+    maxX = std::max(maxX, bodies.x[i]);
+    maxRadius = std::max(maxRadius, bodies.radius[i]);
+  }
+  halo = 2.0f * maxRadius;
+
+  if (bounds.size() != count + 1) {
+    bounds.resize(count + 1);
+    for (size_t d = 1; d < count; ++d) {
+      bounds[d] = minX + (maxX - minX) * static_cast<float>(d) / static_cast<float>(count);
+    }
+  }
+  bounds.front() = -infinity;
+  bounds.back() = infinity;
+
+  for (Domain& domain : domains) {
+    domain.owned.clear();
+  }
+  for (size_t i = 0; i < bodies.size(); ++i) {
+    domains[domainOf(bodies.x[i])].owned.push_back(static_cast<uint32_t>(i));
+  }
+  assigned = true;
+  // Costs were measured on the old ownership, so they get a full interval on the new one first
+  stepsSinceRebalance = 0;
+}
+
+// Spreads each domain's measured cost evenly over the circles it owns, then cuts the x axis where
+// the running total of that cost reaches each equal share. Circles whose strip moved out from
+// under them migrate on the next scan.
+void DomainDecomposition::rebalance(const CircleWorld& bodies) {
+  size_t count = domains.size();
+  float minX = infinity, maxX = -infinity;
+  double total = 0.0;
+  for (const Domain& domain : domains) {
+    if (domain.owned.empty()) continue;
+    for (uint32_t id : domain.owned) {
+      minX = std::min(minX, bodies.x[id]);
+      maxX = std::max(maxX, bodies.x[id]);
+    }
+    total += domain.cost;
+  }
+  if (!(maxX > minX) || total <= 0.0) return;
+
+  size_t binCount = 64 * count;
+  float binWidth = (maxX - minX) / static_cast<float>(binCount);
+  std::vector<double> bins(binCount, 0.0);
+  for (const Domain& domain : domains) {
+    if (domain.owned.empty()) continue;
+    double weight = domain.cost / static_cast<double>(domain.owned.size());
+    for (uint32_t id : domain.owned) {
+      size_t bin = std::min(static_cast<size_t>(std::max(bodies.x[id] - minX, 0.0f) / binWidth), binCount - 1);
+      bins[bin] += weight;
+    }
+  }
+
+  double share = total / static_cast<double>(count);
+  double running = 0.0;
+  size_t next = 1;
+  for (size_t bin = 0; bin < binCount && next < count; ++bin) {
+    while (next < count && running + bins[bin] >= share * static_cast<double>(next)) {
+      double into = bins[bin] > 0.0 ? (share * static_cast<double>(next) - running) / bins[bin] : 0.0;
+      bounds[next++] = minX + binWidth * (static_cast<float>(bin) + static_cast<float>(into));
+    }
+    running += bins[bin];
+  }
+}
+
+// Sorts each owned circle into staying, migrating and being needed as a ghost by other domains
+void DomainDecomposition::scan(size_t d, const CircleWorld& bodies) {
+  Domain& domain = domains[d];
+  size_t count = domains.size();
+  domain.migrateTo.resize(count);
+  domain.ghostTo.resize(count);
+  for (size_t k = 0; k < count; ++k) {
+    domain.migrateTo[k].clear();
+    domain.ghostTo[k].clear();
+  }
+
+  size_t kept = 0;
+  for (uint32_t id : domain.owned) {
+    float x = bodies.x[id];
+    size_t home = domainOf(x);
+    if (home == d) domain.owned[kept++] = id;
+    else domain.migrateTo[home].push_back(id);
+
+    for (size_t k = domainOf(x - halo); k <= domainOf(x + halo); ++k) {
+      if (k != home) domain.ghostTo[k].push_back(id);
+    }
+  }
+  domain.owned.resize(kept);
+}
+
+void DomainDecomposition::merge(size_t d) {
+  Domain& domain = domains[d];
+  domain.ghosts.clear();
+  domain.ghostOwner.clear();
+  for (size_t k = 0; k < domains.size(); ++k) {
+    const std::vector<uint32_t>& arriving = domains[k].migrateTo[d];
+    domain.owned.insert(domain.owned.end(), arriving.begin(), arriving.end());
+  }
+  // Ghosts come from every domain's scan, so which domain now owns each one is looked up afresh
+  for (size_t k = 0; k < domains.size(); ++k) {
+    const std::vector<uint32_t>& ghosts = domains[k].ghostTo[d];
+    domain.ghosts.insert(domain.ghosts.end(), ghosts.begin(), ghosts.end());
+  }
+}
+
+size_t DomainDecomposition::solve(size_t d, const CircleWorld& bodies, const uint8_t* awake) {
+  auto start = std::chrono::steady_clock::now();
+  Domain& domain = domains[d];
+  size_t ownedCount = domain.owned.size();
+  size_t total = ownedCount + domain.ghosts.size();
+
+  CircleWorld& local = domain.local;
+  local.x.resize(total);
+  local.y.resize(total);
+  local.vx.resize(total);
+  local.vy.resize(total);
+  local.radius.resize(total);
+  local.invMass.resize(total);
+  domain.ghostOwner.resize(domain.ghosts.size());
+  for (size_t i = 0; i < total; ++i) {
+    uint32_t id = i < ownedCount ? domain.owned[i] : domain.ghosts[i - ownedCount];
+    local.x[i] = bodies.x[id];
+    local.y[i] = bodies.y[id];
+    local.vx[i] = bodies.vx[id];
+    local.vy[i] = bodies.vy[id];
+    local.radius[i] = bodies.radius[id];
+    local.invMass[i] = bodies.invMass[id];
+    if (i >= ownedCount) domain.ghostOwner[i - ownedCount] = static_cast<uint32_t>(domainOf(local.x[i]));
+  }
+
+  domain.grid.findPairs(local, domain.pairs);
+  size_t tested = domain.pairs.size();
+  const PhysicsKernels& kernels = physicsKernels();
+  domain.pairs.resize(kernels.filterContacts(local.x.data(), local.y.data(), local.radius.data(),
+                                             domain.pairs.data(), domain.pairs.size(), domain.pairs.data()));
+
+  // Keep pairs this domain is responsible for: anything with an owned circle, unless the other
+  // side is a ghost owned further left, whose domain resolves it instead
+  auto worldId = [&](uint32_t i) { return i < ownedCount ? domain.owned[i] : domain.ghosts[i - ownedCount]; };
+  std::vector<CandidatePair>& found = contacts[d];
+  found.clear();
+  size_t kept = 0;
+  for (const CandidatePair& pair : domain.pairs) {
+    bool ghostA = pair.a >= ownedCount;
+    bool ghostB = pair.b >= ownedCount;
+    if (ghostA && ghostB) continue;
+    if (ghostA && domain.ghostOwner[pair.a - ownedCount] < d) continue;
+    if (ghostB && domain.ghostOwner[pair.b - ownedCount] < d) continue;
+    uint32_t a = worldId(pair.a);
+    uint32_t b = worldId(pair.b);
+    if (awake && !awake[a] && !awake[b]) continue;
+    domain.pairs[kept++] = pair;
+    found.push_back(CandidatePair{std::min(a, b), std::max(a, b)});
+  }
+  resolvePairsBatched(local, domain.pairs.data(), kept, domain.scratch);
+
+  domain.deltas.resize(domains.size());
+  for (std::vector<GhostDelta>& deltas : domain.deltas) {
+    deltas.clear();
+  }
+  for (size_t g = 0; g < domain.ghosts.size(); ++g) {
+    uint32_t owner = domain.ghostOwner[g];
+    if (owner < d) continue;
+    size_t i = ownedCount + g;
+    uint32_t id = domain.ghosts[g];
+    GhostDelta delta{id, local.x[i] - bodies.x[id], local.y[i] - bodies.y[id],
+                     local.vx[i] - bodies.vx[id], local.vy[i] - bodies.vy[id]};
+    if (delta.x != 0.0f || delta.y != 0.0f || delta.vx != 0.0f || delta.vy != 0.0f) {
+      domain.deltas[owner].push_back(delta);
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  domain.cost = domain.cost > 0.0 ? 0.5 * (domain.cost + seconds) : seconds;
+  return tested;
+}
+
+void DomainDecomposition::writeBack(size_t d, CircleWorld& bodies) {
+  Domain& domain = domains[d];
+  const CircleWorld& local = domain.local;
+  for (size_t i = 0; i < domain.owned.size(); ++i) {
+    uint32_t id = domain.owned[i];
+    bodies.x[id] = local.x[i];
+    bodies.y[id] = local.y[i];
+    bodies.vx[id] = local.vx[i];
+    bodies.vy[id] = local.vy[i];
+  }
+  for (size_t k = 0; k < d; ++k) {
+    for (const GhostDelta& delta : domains[k].deltas[d]) {
+      bodies.x[delta.id] += delta.x;
+      bodies.y[delta.id] += delta.y;
+      bodies.vx[delta.id] += delta.vx;
+      bodies.vy[delta.id] += delta.vy;
+    }
+  }
+}
+
+size_t DomainDecomposition::resolveCollisions(CircleWorld& bodies, const uint8_t* awake, JobSystem& jobs) {
+  if (domains.empty()) setDomainCount(jobs.size());
+  size_t count = domains.size();
+  contacts.resize(count);
+  pairTests.resize(count);
+  if (bodies.empty()) return 0;
+
+  if (!assigned) assignAll(bodies);
+  if (++stepsSinceRebalance >= rebalanceInterval) {
+    rebalance(bodies);
+    stepsSinceRebalance = 0;
+  }
+
+  // Every phase touches only its own domain's state plus what others finished in an earlier phase
+  jobs.parallelFor(count, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t d = begin; d < end; ++d) scan(d, bodies);
+  });
+  jobs.parallelFor(count, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t d = begin; d < end; ++d) merge(d);
+  });
+  jobs.parallelFor(count, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t d = begin; d < end; ++d) pairTests[d] = solve(d, bodies, awake);
+  });
+  jobs.parallelFor(count, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t d = begin; d < end; ++d) writeBack(d, bodies);
+  });
+
+  size_t tested = 0;
+  for (size_t d = 0; d < count; ++d) {
+    tested += pairTests[d];
+  }
+  return tested;
+}
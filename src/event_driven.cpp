@@ -0,0 +1,227 @@
+#include "event_driven.h"
+#include "narrowphase.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static constexpr double never = std::numeric_limits<double>::infinity();
+
+// Time from now until a circle at p moving at v touches the wall it is heading for. One already
+// pressing into a wall bounces straight away.
+static double wallTime(float p, float v, float radius, float minBound, float maxBound) {
+  if (v < 0.0f) return std::max(0.0, (double(minBound) + radius - p) / v);
+  if (v > 0.0f) return std::max(0.0, (double(maxBound) - radius - p) / v);
+  return never;
+}
+
+// Time from now until a circle at p moving at v leaves the cell [lo, lo + size), if there is one that way
+static double crossTime(float p, float v, float lo, float size, int c, int cols) {
+  if (v > 0.0f && c < cols - 1) return std::max(0.0, (double(lo) + size - p) / v);
+  if (v < 0.0f && c > 0) return std::max(0.0, (double(lo) - p) / v);
+  return never;
+}
+
+void EventDrivenSim::reset(const CircleWorld& circles, float minBound, float maxBound) {
+  bodies = circles;
+  this->minBound = minBound;
+  this->maxBound = maxBound;
+  size_t n = bodies.size();
+  now = 0.0;
+  stamp.assign(n, 0.0);
+  counts.assign(n, 0);
+  counters = EventStats{};
+
+  // Cells at least one diameter wide, and no more of them than circles
+  float maxRadius = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    maxRadius = std::max(maxRadius, bodies.radius[i]);
+  }
+  float span = maxBound - minBound;
+  cols = std::max(1, static_cast<int>(span / std::max(2.0f * maxRadius, 1e-6f)));
+  cols = std::min(cols, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(n)))) + 1);
+  cell = span / static_cast<float>(cols);
+  members.assign(static_cast<size_t>(cols) * cols, {});
+  cellX.assign(n, 0);
+  cellY.assign(n, 0);
+  slot.assign(n, 0);
+  for (size_t i = 0; i < n; ++i) {
+    int cx = std::clamp(static_cast<int>(std::floor((bodies.x[i] - minBound) / cell)), 0, cols - 1);
+    int cy = std::clamp(static_cast<int>(std::floor((bodies.y[i] - minBound) / cell)), 0, cols - 1);
+    std::vector<uint32_t>& list = members[static_cast<size_t>(cy) * cols + cx];
+    cellX[i] = cx;
+    cellY[i] = cy;
+    slot[i] = static_cast<uint32_t>(list.size());
+    list.push_back(static_cast<uint32_t>(i));
+  }
+  rebuildQueue();
+}
+
+void EventDrivenSim::rebuildQueue() {
+  queue = {};
+  for (uint32_t i = 0; i < bodies.size(); ++i) {
+    drift(i, now);
+  }
+  for (uint32_t i = 0; i < bodies.size(); ++i) {
+    predict(i);
+  }
+  queueLimit = 2 * queue.size() + 1024;
+}
+
+void EventDrivenSim::drift(uint32_t i, double time) {
+  float elapsed = static_cast<float>(time - stamp[i]);
+  bodies.x[i] += bodies.vx[i] * elapsed;
+  bodies.y[i] += bodies.vy[i] * elapsed;
+  stamp[i] = time;
+}
+
+void EventDrivenSim::push(uint32_t a, int32_t other, double time) {
+  if (time == never) return;
+  queue.push(Event{time, a, other, counts[a], other >= 0 ? counts[other] : 0});
+}
+
+// Queues the next wall, cell edge and circle that i, which must be up to date, will reach
+void EventDrivenSim::predict(uint32_t i) {
+  double hitX = wallTime(bodies.x[i], bodies.vx[i], bodies.radius[i], minBound, maxBound);
+  double hitY = wallTime(bodies.y[i], bodies.vy[i], bodies.radius[i], minBound, maxBound);
+  if (hitX <= hitY) push(i, wallX, now + hitX);
+  else push(i, wallY, now + hitY);
+
+  predictCrossing(i);
+  int cx = cellX[i];
+  int cy = cellY[i];
+  predictContacts(i, cx - 1, cx + 1, cy - 1, cy + 1);
+}
+
+void EventDrivenSim::predictCrossing(uint32_t i) {
+  int cx = cellX[i];
+  int cy = cellY[i];
+  double leaveX = crossTime(bodies.x[i], bodies.vx[i], minBound + cx * cell, cell, cx, cols);
+  double leaveY = crossTime(bodies.y[i], bodies.vy[i], minBound + cy * cell, cell, cy, cols);
+  if (leaveX <= leaveY) push(i, crossX, now + leaveX);
+  else push(i, crossY, now + leaveY);
+}
+
+// Queues contacts between i and the circles in cells [x0, x1] x [y0, y1]
+void EventDrivenSim::predictContacts(uint32_t i, int x0, int x1, int y0, int y1) {
+  float px = bodies.x[i];
+  float py = bodies.y[i];
+  float vx = bodies.vx[i];
+  float vy = bodies.vy[i];
+  float r = bodies.radius[i];
+  for (int y = std::max(y0, 0); y <= std::min(y1, cols - 1); ++y) {
+    for (int x = std::max(x0, 0); x <= std::min(x1, cols - 1); ++x) {
+      for (uint32_t j : members[static_cast<size_t>(y) * cols + x]) {
+        if (j == i) continue;
+        // Same contact time as the sweeps in ContinuousCollision, with j brought forward to now
+        float elapsed = static_cast<float>(now - stamp[j]);
+        float dx = px - (bodies.x[j] + bodies.vx[j] * elapsed);
+        float dy = py - (bodies.y[j] + bodies.vy[j] * elapsed);
+        float wx = vx - bodies.vx[j];
+        float wy = vy - bodies.vy[j];
+        float closing = dx * wx + dy * wy;
+        if (closing >= 0.0f) continue;
+
+        float reach = r + bodies.radius[j];
+        float gap = dx * dx + dy * dy - reach * reach;
+        if (gap <= 0.0f) {
+          push(i, static_cast<int32_t>(j), now);
+          continue;
+        }
+        float disc = closing * closing - (wx * wx + wy * wy) * gap;
+        if (disc < 0.0f) continue;
+        push(i, static_cast<int32_t>(j), now + gap / (std::sqrt(disc) - closing));
+      }
+    }
+  }
+}
+
+void EventDrivenSim::moveToCell(uint32_t i, int cx, int cy) {
+  std::vector<uint32_t>& from = members[static_cast<size_t>(cellY[i]) * cols + cellX[i]];
+  uint32_t last = from.back();
+  from[slot[i]] = last;
+  slot[last] = slot[i];
+  from.pop_back();
+
+  std::vector<uint32_t>& to = members[static_cast<size_t>(cy) * cols + cx];
+  cellX[i] = cx;
+  cellY[i] = cy;
+  slot[i] = static_cast<uint32_t>(to.size());
+  to.push_back(i);
+}
+
+void EventDrivenSim::process(const Event& event) {
+  uint32_t a = event.a;
+  if (counts[a] != event.countA || (event.other >= 0 && counts[event.other] != event.countB)) {
+    counters.staleEvents++;
+    return;
+  }
+  now = event.time;
+  drift(a, now);
+
+  if (event.other >= 0) {
+    uint32_t b = static_cast<uint32_t>(event.other);
+    drift(b, now);
+    float dx = bodies.x[a] - bodies.x[b];
+    float dy = bodies.y[a] - bodies.y[b];
+    float dist = std::sqrt(dx * dx + dy * dy);
+    if (dist > 0.0f) applyElasticImpulse(bodies, a, b, dx / dist, dy / dist);
+    counters.collisions++;
+    counts[a]++;
+    counts[b]++;
+    predict(a);
+    predict(b);
+    return;
+  }
+
+  if (event.other == wallX) {
+    bodies.vx[a] = -bodies.vx[a];
+    counters.wallBounces++;
+  }
+  else if (event.other == wallY) {
+    bodies.vy[a] = -bodies.vy[a];
+    counters.wallBounces++;
+  }
+  else {
+    // The path is unchanged, so every queued prediction for a still holds. Only the circles that just
+    // came into range need checking. The step comes from the direction of travel, since rounding can
+    // leave the centre a hair short of the edge.
+    int cx = cellX[a];
+    int cy = cellY[a];
+    if (event.other == crossX) {
+      int step = bodies.vx[a] > 0.0f ? 1 : -1;
+      moveToCell(a, std::clamp(cx + step, 0, cols - 1), cy);
+      predictContacts(a, cx + 2 * step, cx + 2 * step, cy - 1, cy + 1);
+    }
+    else {
+      int step = bodies.vy[a] > 0.0f ? 1 : -1;
+      moveToCell(a, cx, std::clamp(cy + step, 0, cols - 1));
+      predictContacts(a, cx - 1, cx + 1, cy + 2 * step, cy + 2 * step);
+    }
+    predictCrossing(a);
+    counters.cellCrossings++;
+    return;
+  }
+  counts[a]++;
+  predict(a);
+}
+
+void EventDrivenSim::advanceTo(double time) {
+  while (!queue.empty() && queue.top().time <= time) {
+    Event event = queue.top();
+    queue.pop();
+    process(event);
+    if (queue.size() > queueLimit) rebuildQueue();
+  }
+  now = std::max(now, time);
+  for (uint32_t i = 0; i < bodies.size(); ++i) {
+    drift(i, now);
+  }
+}
+
+void EventDrivenSim::sample(double interval, size_t count, const std::function<void(double, const CircleWorld&)>& emit) {
+  double start = now;
+  for (size_t k = 1; k <= count; ++k) {
+    advanceTo(start + interval * static_cast<double>(k));
+    emit(now, bodies);
+  }
+}
@@ -0,0 +1,24 @@
+#include "fixed_timestep.h"
+
+FixedTimestep::FixedTimestep(float stepSize, int maxStepsPerFrame)
+  : stepSize(stepSize), maxStepsPerFrame(maxStepsPerFrame) {}
+
+int FixedTimestep::advance(World& world, float frameTime) {
+  accumulator += frameTime;
+
+  int steps = static_cast<int>(accumulator / stepSize);
+  if (steps > maxStepsPerFrame) {
+    // Too far behind to catch up, drop the backlog rather than slowing down further
+    steps = maxStepsPerFrame;
+    accumulator = static_cast<float>(steps) * stepSize;
+  }
+
+  for (int i = 0; i < steps; ++i) {
+    // Only the state before the last step is needed to interpolate this frame
+    if (i == steps - 1) world.storePreviousPositions();
+    world.step(stepSize);
+    accumulator -= stepSize;
+  }
+  if (accumulator < 0.0f) accumulator = 0.0f;
+  return steps;
+}
@@ -0,0 +1,55 @@
+#include "force_field.h"
+#include "job_system.h"
+#include <cmath>
+
+// Runs body over [0, count) in blocks on the job system, or inline without one
+template <typename Body>
+static void forEachBlock(JobSystem* jobs, size_t count, size_t grain, Body body) {
+  if (jobs) jobs->parallelFor(count, grain, [&](size_t begin, size_t end, unsigned) { body(begin, end); });
+  else body(0, count);
+}
+
+void UniformField::accelerations(const CircleWorld& bodies, const float*, const float*, float* ax, float* ay,
+                                 JobSystem* jobs) {
+  forEachBlock(jobs, bodies.size(), 16384, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      ax[i] = gx;
+      ay[i] = gy;
+    }
+  });
+}
+
+void CentralSpring::accelerations(const CircleWorld& bodies, const float* x, const float* y, float* ax, float* ay,
+                                  JobSystem* jobs) {
+  forEachBlock(jobs, bodies.size(), 16384, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      ax[i] = -stiffness * x[i];
+      ay[i] = -stiffness * y[i];
+    }
+  });
+}
+
+void PairwiseGravity::accelerations(const CircleWorld& bodies, const float* x, const float* y, float* ax, float* ay,
+                                    JobSystem* jobs) {
+  size_t n = bodies.size();
+  const float* invMass = bodies.invMass.data();
+  float softSq = softening * softening;
+
+  // A circle's pull on itself has zero offset, so it adds nothing and needs no special case
+  forEachBlock(jobs, n, 64, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      float sumX = 0.0f;
+      float sumY = 0.0f;
+      for (size_t j = 0; j < n; ++j) {
+        float dx = x[j] - x[i];
+        float dy = y[j] - y[i];
+        float distSq = dx * dx + dy * dy + softSq;
+        float inv = 1.0f / (distSq * std::sqrt(distSq) * invMass[j]);
+        sumX += dx * inv;
+        sumY += dy * inv;
+      }
+      ax[i] = strength * sumX;
+      ay[i] = strength * sumY;
+    }
+  });
+}
@@ -0,0 +1,139 @@
+#include "instance_ring.h"
+#include <algorithm>
+#include <cstring>
+#include <fmt/core.h>
+
+static constexpr size_t minimumCapacity = 1024;
+static constexpr GLbitfield persistentFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+void InstanceRing::create() {
+  persistentMapping = GLAD_GL_ARB_buffer_storage != 0;
+  reserve(minimumCapacity);
+}
+
+void InstanceRing::destroy() {
+  for (GLsync& sync : fences) {
+    if (sync) glDeleteSync(sync);
+    sync = nullptr;
+  }
+  if (mapped) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    mapped = nullptr;
+  }
+  if (buffer) glDeleteBuffers(1, &buffer);
+  buffer = 0;
+  capacity = 0;
+  count = 0;
+}
+
+// Grows the buffer to hold that many circles per region. The old buffer is dropped whole, GL keeps it
+// alive until the frames drawing from it are done.
+void InstanceRing::reserve(size_t circles) {
+  if (buffer && circles <= capacity) return;
+  size_t grown = std::max({circles, capacity * 2, minimumCapacity});
+  destroy();
+  capacity = grown;
+
+  GLsizeiptr size = static_cast<GLsizeiptr>(capacity * 2 * sizeof(float) * regionCount);
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  if (persistentMapping) {
+    glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, persistentFlags);
+    mapped = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, persistentFlags));
+    if (!mapped) {
+      // Storage made with the write bit can still be mapped a frame at a time
+      fmt::print(stderr, "Persistent mapping failed, mapping instance regions per frame.\n");
+      persistentMapping = false;
+    }
+  }
+  else {
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceRing::waitFor(int index) {
+  GLsync& sync = fences[index];
+  if (!sync) return;
+  // Three frames back, so this almost never blocks
+  while (true) {
+    GLenum status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED) break;
+  }
+  glDeleteSync(sync);
+  sync = nullptr;
+}
+
+void InstanceRing::upload(const float* data, size_t circles, const std::vector<BodyRange>& ranges) {
+  if (circles != count) {
+    reserve(circles);
+    count = circles;
+    for (std::vector<BodyRange>& missed : behind) {
+      missed.clear();
+      if (count > 0) missed.push_back(BodyRange{0, count});
+    }
+  }
+  region = (region + 1) % regionCount;
+  for (int other = 0; other < regionCount; ++other) {
+    if (other != region) behind[other].insert(behind[other].end(), ranges.begin(), ranges.end());
+  }
+
+  // What this region missed and what changed now, merged so nothing is copied twice
+  spans.assign(behind[region].begin(), behind[region].end());
+  spans.insert(spans.end(), ranges.begin(), ranges.end());
+  std::sort(spans.begin(), spans.end(), [](const BodyRange& a, const BodyRange& b) { return a.begin < b.begin; });
+  size_t merged = 0;
+  for (const BodyRange& span : spans) {
+    if (merged > 0 && span.begin <= spans[merged - 1].end) {
+      spans[merged - 1].end = std::max(spans[merged - 1].end, span.end);
+    }
+    else {
+      spans[merged++] = span;
+    }
+  }
+  spans.resize(merged);
+  if (spans.empty()) return;
+
+  waitFor(region);
+  size_t base = static_cast<size_t>(region) * capacity * 2;
+  float* target = nullptr;
+  if (persistentMapping) {
+    target = mapped + base;
+  }
+  else {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    target = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, base * sizeof(float), count * 2 * sizeof(float),
+                                                  GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
+    if (!target) {
+      // Still missing, try again next time round
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      behind[region].assign(spans.begin(), spans.end());
+      return;
+    }
+  }
+
+  for (const BodyRange& span : spans) {
+    size_t bytes = (span.end - span.begin) * 2 * sizeof(float);
+    std::memcpy(target + span.begin * 2, data + span.begin * 2, bytes);
+    if (!persistentMapping) glFlushMappedBufferRange(GL_ARRAY_BUFFER, span.begin * 2 * sizeof(float), bytes);
+  }
+  behind[region].clear();
+  if (!persistentMapping) {
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+}
+
+void InstanceRing::bindAttribute(GLuint attribute) const {
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  size_t offset = static_cast<size_t>(region) * capacity * 2 * sizeof(float);
+  glVertexAttribPointer(attribute, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), reinterpret_cast<void*>(offset));
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceRing::fence() {
+  if (fences[region]) glDeleteSync(fences[region]);
+  fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,149 @@
+#include "integrator.h"
+#include "job_system.h"
+#include "kernels.h"
+#include <algorithm>
+
+const char* integratorName(IntegratorKind kind) {
+  switch (kind) {
+    case IntegratorKind::ExplicitEuler: return "euler";
+    case IntegratorKind::SemiImplicitEuler: return "symplectic";
+    case IntegratorKind::VelocityVerlet: return "verlet";
+    case IntegratorKind::Rk4: return "rk4";
+  }
+  return "unknown";
+}
+
+bool parseIntegratorKind(const std::string& name, IntegratorKind& kind) {
+  if (name == "euler") kind = IntegratorKind::ExplicitEuler;
+  else if (name == "symplectic") kind = IntegratorKind::SemiImplicitEuler;
+  else if (name == "verlet") kind = IntegratorKind::VelocityVerlet;
+  else if (name == "rk4") kind = IntegratorKind::Rk4;
+  else return false;
+  return true;
+}
+
+// Blocks are a multiple of every vector width, so only the last one has a scalar tail
+static constexpr size_t blockSize = 16384;
+
+template <typename Body>
+static void forEachBlock(JobSystem* jobs, size_t count, Body body) {
+  if (jobs) jobs->parallelFor(count, blockSize, [&](size_t begin, size_t end, unsigned) { body(begin, end); });
+  else body(0, count);
+}
+
+// out = a + scale * b over whole arrays
+static void addScaled(JobSystem* jobs, float* out, const float* a, const float* b, float scale, size_t count) {
+  const PhysicsKernels& kernels = physicsKernels();
+  forEachBlock(jobs, count, [&](size_t begin, size_t end) {
+    kernels.addScaled(out + begin, a + begin, b + begin, scale, end - begin);
+  });
+}
+
+static void copy(JobSystem* jobs, float* out, const float* in, size_t count) {
+  forEachBlock(jobs, count, [&](size_t begin, size_t end) { std::copy(in + begin, in + end, out + begin); });
+}
+
+void Integrator::setKind(IntegratorKind kind) {
+  integratorKind = kind;
+  accelerationsValid = false;
+}
+
+void Integrator::evaluate(CircleWorld& bodies, ForceField& field, const float* x, const float* y, JobSystem* jobs) {
+  field.accelerations(bodies, x, y, ax.data(), ay.data(), jobs);
+  evaluations++;
+}
+
+void Integrator::step(CircleWorld& bodies, ForceField& field, float dt, float minBound, float maxBound,
+                      JobSystem* jobs) {
+  size_t n = bodies.size();
+  if (ax.size() != n) {
+    ax.resize(n);
+    ay.resize(n);
+    accelerationsValid = false;
+  }
+  float* x = bodies.x.data();
+  float* y = bodies.y.data();
+  float* vx = bodies.vx.data();
+  float* vy = bodies.vy.data();
+
+  switch (integratorKind) {
+    case IntegratorKind::ExplicitEuler:
+      evaluate(bodies, field, x, y, jobs);
+      addScaled(jobs, x, x, vx, dt, n);
+      addScaled(jobs, y, y, vy, dt, n);
+      addScaled(jobs, vx, vx, ax.data(), dt, n);
+      addScaled(jobs, vy, vy, ay.data(), dt, n);
+      break;
+    case IntegratorKind::SemiImplicitEuler:
+      evaluate(bodies, field, x, y, jobs);
+      addScaled(jobs, vx, vx, ax.data(), dt, n);
+      addScaled(jobs, vy, vy, ay.data(), dt, n);
+      addScaled(jobs, x, x, vx, dt, n);
+      addScaled(jobs, y, y, vy, dt, n);
+      break;
+    case IntegratorKind::VelocityVerlet:
+      // Kick half a step, drift a whole one, then kick again with the forces at the new positions
+      if (!accelerationsValid) evaluate(bodies, field, x, y, jobs);
+      addScaled(jobs, vx, vx, ax.data(), 0.5f * dt, n);
+      addScaled(jobs, vy, vy, ay.data(), 0.5f * dt, n);
+      addScaled(jobs, x, x, vx, dt, n);
+      addScaled(jobs, y, y, vy, dt, n);
+      evaluate(bodies, field, x, y, jobs);
+      addScaled(jobs, vx, vx, ax.data(), 0.5f * dt, n);
+      addScaled(jobs, vy, vy, ay.data(), 0.5f * dt, n);
+      break;
+    case IntegratorKind::Rk4:
+      stepRk4(bodies, field, dt, jobs);
+      break;
+  }
+
+  // A zero step applies only the walls. Verlet's accelerations stay in use even if a circle was pushed
+  // back inside, the difference is at most one step of motion.
+  const PhysicsKernels& kernels = physicsKernels();
+  forEachBlock(jobs, n, [&](size_t begin, size_t end) {
+    kernels.integrateBounded(x + begin, y + begin, vx + begin, vy + begin, bodies.radius.data() + begin,
+                             end - begin, 0.0f, minBound, maxBound);
+  });
+  accelerationsValid = integratorKind == IntegratorKind::VelocityVerlet;
+}
+
+// Classic RK4 on x' = v, v' = a(x). Each stage takes a trial state from the start of the step plus a
+// fraction of the previous stage's slopes, and the slopes are summed with weights 1, 2, 2, 1.
+void Integrator::stepRk4(CircleWorld& bodies, ForceField& field, float dt, JobSystem* jobs) {
+  size_t n = bodies.size();
+  for (AlignedVector<float>* buffer : {&trialX, &trialY, &trialVx, &trialVy, &sumX, &sumY, &sumVx, &sumVy}) {
+    buffer->resize(n);
+  }
+  float* x = bodies.x.data();
+  float* y = bodies.y.data();
+  float* vx = bodies.vx.data();
+  float* vy = bodies.vy.data();
+
+  evaluate(bodies, field, x, y, jobs);
+  copy(jobs, trialVx.data(), vx, n);
+  copy(jobs, trialVy.data(), vy, n);
+  copy(jobs, sumX.data(), vx, n);
+  copy(jobs, sumY.data(), vy, n);
+  copy(jobs, sumVx.data(), ax.data(), n);
+  copy(jobs, sumVy.data(), ay.data(), n);
+
+  const float fractions[3] = {0.5f, 0.5f, 1.0f};
+  const float weights[3] = {2.0f, 2.0f, 1.0f};
+  for (int stage = 0; stage < 3; ++stage) {
+    float h = fractions[stage] * dt;
+    addScaled(jobs, trialX.data(), x, trialVx.data(), h, n);
+    addScaled(jobs, trialY.data(), y, trialVy.data(), h, n);
+    addScaled(jobs, trialVx.data(), vx, ax.data(), h, n);
+    addScaled(jobs, trialVy.data(), vy, ay.data(), h, n);
+    evaluate(bodies, field, trialX.data(), trialY.data(), jobs);
+    addScaled(jobs, sumX.data(), sumX.data(), trialVx.data(), weights[stage], n);
+    addScaled(jobs, sumY.data(), sumY.data(), trialVy.data(), weights[stage], n);
+    addScaled(jobs, sumVx.data(), sumVx.data(), ax.data(), weights[stage], n);
+    addScaled(jobs, sumVy.data(), sumVy.data(), ay.data(), weights[stage], n);
+  }
+
+  addScaled(jobs, x, x, sumX.data(), dt / 6.0f, n);
+  addScaled(jobs, y, y, sumY.data(), dt / 6.0f, n);
+  addScaled(jobs, vx, vx, sumVx.data(), dt / 6.0f, n);
+  addScaled(jobs, vy, vy, sumVy.data(), dt / 6.0f, n);
+}
@@ -0,0 +1,133 @@
+#include "force_field.h"
+#include "integrator.h"
+#include "job_system.h"
+#include "kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <fmt/core.h>
+
+// Accuracy against cost for every integrator. Circles oscillate on a spring towards the origin, which has
+// an exact solution, so the error after a fixed simulated time can be measured for several step sizes.
+
+struct BenchOptions {
+  size_t bodies = 100000;
+  float seconds = 10.0f;
+  unsigned threads = 1;
+  unsigned seed = 1;
+};
+
+static void printUsage() {
+  fmt::print(stderr,
+    "Usage: collision_integrator_bench [options]\n"
+    "  --bodies N    Number of circles (default 100000)\n"
+    "  --seconds T   Simulated time per run (default 10)\n"
+    "  --threads N   Worker threads including the main one (default 1)\n"
+    "  --seed N      Random seed (default 1)\n");
+}
+
+static bool parseArgs(int argc, char** argv, BenchOptions& options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") return false;
+    if (i + 1 >= argc) {
+      fmt::print(stderr, "Missing value for {}\n", arg);
+      return false;
+    }
+    std::string value = argv[++i];
+
+    if (arg == "--bodies") options.bodies = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--seconds") options.seconds = std::strtof(value.c_str(), nullptr);
+    else if (arg == "--threads") options.threads = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    else if (arg == "--seed") options.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    else {
+      fmt::print(stderr, "Unknown option: {}\n", arg);
+      return false;
+    }
+  }
+
+  if (options.bodies == 0 || options.seconds <= 0.0f) {
+    fmt::print(stderr, "Bodies and seconds must be positive.\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  if (!parseArgs(argc, argv, options)) {
+    printUsage();
+    return 1;
+  }
+
+  // One oscillation per second. Amplitudes stay under 0.6, so no circle reaches the walls.
+  const double omega = 2.0 * M_PI;
+  CentralSpring spring(static_cast<float>(omega * omega));
+  std::mt19937 rng(options.seed);
+  std::uniform_real_distribution<float> position(-0.4f, 0.4f);
+  std::uniform_real_distribution<float> velocity(-0.4f * static_cast<float>(omega), 0.4f * static_cast<float>(omega));
+  CircleWorld start;
+  start.reserve(options.bodies);
+  for (size_t i = 0; i < options.bodies; ++i) {
+    start.add(Circle(position(rng), position(rng), velocity(rng), velocity(rng), 0.005f, 1.0f));
+  }
+
+  auto energy = [&](const CircleWorld& bodies) {
+    double total = 0.0;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+      double speedSq = double(bodies.vx[i]) * bodies.vx[i] + double(bodies.vy[i]) * bodies.vy[i];
+      double distSq = double(bodies.x[i]) * bodies.x[i] + double(bodies.y[i]) * bodies.y[i];
+      total += 0.5 * speedSq + 0.5 * omega * omega * distSq;
+    }
+    return total;
+  };
+  double startEnergy = energy(start);
+
+  std::unique_ptr<JobSystem> jobs;
+  if (options.threads > 1) jobs = std::make_unique<JobSystem>(options.threads);
+
+  fmt::print("{} bodies, {} s simulated, kernels = {}, threads = {}\n", options.bodies, options.seconds,
+             isaName(physicsKernels().isa), options.threads);
+  fmt::print("{:<11} {:>9} {:>8} {:>12} {:>12} {:>13} {:>13}\n",
+             "integrator", "dt", "steps", "evals/step", "ns/body-step", "max error", "energy drift");
+
+  const float stepSizes[] = {1.0f / 15.0f, 1.0f / 30.0f, 1.0f / 60.0f, 1.0f / 120.0f, 1.0f / 240.0f};
+  for (int k = 0; k < integratorKindCount; ++k) {
+    IntegratorKind kind = static_cast<IntegratorKind>(k);
+    for (float dt : stepSizes) {
+      size_t steps = static_cast<size_t>(std::lround(options.seconds / dt));
+      CircleWorld bodies = start;
+      Integrator integrator;
+      integrator.setKind(kind);
+
+      auto begin = std::chrono::steady_clock::now();
+      for (size_t s = 0; s < steps; ++s) {
+        integrator.step(bodies, spring, dt, -1.0f, 1.0f, jobs.get());
+      }
+      auto end = std::chrono::steady_clock::now();
+      double seconds = std::chrono::duration<double>(end - begin).count();
+
+      // Exact solution of x'' = -omega² x at the time actually simulated
+      double t = static_cast<double>(steps) * dt;
+      double c = std::cos(omega * t);
+      double sn = std::sin(omega * t);
+      double maxError = 0.0;
+      for (size_t i = 0; i < bodies.size(); ++i) {
+        double ex = start.x[i] * c + start.vx[i] / omega * sn;
+        double ey = start.y[i] * c + start.vy[i] / omega * sn;
+        maxError = std::max(maxError, std::hypot(bodies.x[i] - ex, bodies.y[i] - ey));
+      }
+      double drift = (energy(bodies) - startEnergy) / startEnergy;
+
+      fmt::print("{:<11} {:>9.5f} {:>8} {:>12.2f} {:>12.2f} {:>13.3e} {:>+13.3e}\n", integratorName(kind), dt, steps,
+                 static_cast<double>(integrator.forceEvaluations()) / steps,
+                 1e9 * seconds / (static_cast<double>(steps) * options.bodies), maxError, drift);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include "job_system.h"
+#include <algorithm>
+
+// Shared state of one parallelFor call, lives on the caller's stack until every index is done
+struct RangeGroup {
+  const JobSystem::RangeBody* body;
+  size_t grain;
+  std::atomic<size_t> remaining;
+  std::vector<JobTask> arena;
+  std::atomic<size_t> used{0};
+};
+
+// Job system the current thread is a worker of, and its index there
+static thread_local const JobSystem* workerOf = nullptr;
+static thread_local unsigned workerIndex = 0;
+
+TaskGraph::Node TaskGraph::add(std::function<void()> work) {
+  nodes.push_back(Entry{std::move(work), {}, 0});
+  return nodes.size() - 1;
+}
+
+void TaskGraph::precede(Node before, Node after) {
+  nodes[before].successors.push_back(after);
+  nodes[after].dependencies++;
+}
+
+void TaskGraph::clear() {
+  nodes.clear();
+  tasks.clear();
+  pending.reset();
+}
+
+JobSystem::JobSystem(unsigned threadCount) {
+  threadCount = std::max(threadCount, 1u);
+  for (unsigned i = 0; i < threadCount; ++i) {
+    queues.push_back(std::make_unique<WorkQueue>());
+  }
+  for (unsigned i = 1; i < threadCount; ++i) {
+    workers.emplace_back(&JobSystem::workerLoop, this, i);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+void JobSystem::push(unsigned thread, Task* task) {
+  {
+    std::lock_guard<std::mutex> lock(queues[thread]->mutex);
+    queues[thread]->tasks.push_back(task);
+  }
+  queued.fetch_add(1);
+  if (sleepers.load() > 0) {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    wake.notify_one();
+  }
+}
+
+JobSystem::Task* JobSystem::pop(unsigned thread) {
+  WorkQueue& queue = *queues[thread];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty()) return nullptr;
+  Task* task = queue.tasks.back();
+  queue.tasks.pop_back();
+  queued.fetch_sub(1);
+  return task;
+}
+
+JobSystem::Task* JobSystem::steal(unsigned thread) {
+  unsigned count = size();
+  for (unsigned offset = 1; offset < count; ++offset) {
+    WorkQueue& queue = *queues[(thread + offset) % count];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) continue;
+    // The oldest task is usually the biggest range left
+    Task* task = queue.tasks.front();
+    queue.tasks.pop_front();
+    queued.fetch_sub(1);
+    return task;
+  }
+  return nullptr;
+}
+
+bool JobSystem::runOne(unsigned thread) {
+  Task* task = pop(thread);
+  if (!task) task = steal(thread);
+  if (!task) return false;
+  execute(task, thread);
+  return true;
+}
+
+void JobSystem::execute(Task* task, unsigned thread) {
+  if (task->group) {
+    RangeGroup& group = *task->group;
+    size_t begin = task->begin;
+    size_t end = task->end;
+
+    // Split off the upper half for thieves until the piece left is small enough to run
+    while (end - begin > group.grain) {
+      size_t mid = begin + (end - begin) / 2;
+      Task* rest = &group.arena[group.used.fetch_add(1)];
+      rest->group = &group;
+      rest->begin = mid;
+      rest->end = end;
+      push(thread, rest);
+      end = mid;
+    }
+
+    (*group.body)(begin, end, thread);
+    group.remaining.fetch_sub(end - begin, std::memory_order_release);
+    return;
+  }
+
+  TaskGraph& graph = *task->graph;
+  TaskGraph::Entry& entry = graph.nodes[task->node];
+  entry.work();
+  for (TaskGraph::Node next : entry.successors) {
+    if (graph.pending[next].fetch_sub(1) == 1) push(thread, &graph.tasks[next]);
+  }
+  graph.remaining.fetch_sub(1, std::memory_order_release);
+}
+
+unsigned JobSystem::currentThread() const {
+  return workerOf == this ? workerIndex : 0;
+}
+
+void JobSystem::helpUntil(const std::atomic<size_t>& remaining) {
+  unsigned thread = currentThread();
+  while (remaining.load(std::memory_order_acquire) != 0) {
+    if (!runOne(thread)) std::this_thread::yield();
+  }
+}
+
+void JobSystem::workerLoop(unsigned thread) {
+  workerOf = this;
+  workerIndex = thread;
+  for (;;) {
+    if (runOne(thread)) continue;
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    sleepers.fetch_add(1);
+    wake.wait(lock, [&] { return stopping.load() || queued.load() > 0; });
+    sleepers.fetch_sub(1);
+    if (stopping) return;
+  }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const RangeBody& body) {
+  if (count == 0) return;
+  grain = std::max<size_t>(grain, 1);
+  if (workers.empty() || count <= grain) {
+    for (size_t begin = 0; begin < count; begin += grain) {
+      body(begin, std::min(begin + grain, count), currentThread());
+    }
+    return;
+  }
+
+  // Only pieces longer than grain are halved, so none ends up shorter than (grain + 1) / 2, which
+  // bounds how many tasks can exist
+  RangeGroup group{&body, grain, {count}, std::vector<Task>(count / ((grain + 1) / 2) + 1)};
+  Task* root = &group.arena[group.used.fetch_add(1)];
+  root->group = &group;
+  root->begin = 0;
+  root->end = count;
+  execute(root, currentThread());
+  helpUntil(group.remaining);
+}
+
+void JobSystem::run(TaskGraph& graph) {
+  size_t count = graph.nodes.size();
+  if (count == 0) return;
+
+  graph.pending.reset(new std::atomic<int>[count]);
+  graph.tasks.assign(count, Task{});
+  for (size_t i = 0; i < count; ++i) {
+    graph.pending[i].store(graph.nodes[i].dependencies);
+    graph.tasks[i].graph = &graph;
+    graph.tasks[i].node = i;
+  }
+  graph.remaining.store(count);
+
+  unsigned thread = currentThread();
+  for (size_t i = 0; i < count; ++i) {
+    if (graph.nodes[i].dependencies == 0) push(thread, &graph.tasks[i]);
+  }
+  helpUntil(graph.remaining);
+}
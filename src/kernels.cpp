@@ -0,0 +1,116 @@
+#include "kernels.h"
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+
+#if defined(_MSC_VER) && defined(COLLISION_X86_KERNELS)
+#include <intrin.h>
+#endif
+
+namespace kernels_scalar { PhysicsKernels kernelTable(); }
+#if defined(COLLISION_X86_KERNELS)
+namespace kernels_sse2 { PhysicsKernels kernelTable(); }
+namespace kernels_sse42 { PhysicsKernels kernelTable(); }
+namespace kernels_avx2 { PhysicsKernels kernelTable(); }
+namespace kernels_avx512 { PhysicsKernels kernelTable(); }
+#endif
+
+IsaLevel detectIsaLevel() {
+#if defined(COLLISION_X86_KERNELS) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+  __cpuid(info, 1);
+  bool sse2 = (info[3] & (1 << 26)) != 0;
+  bool sse42 = (info[2] & (1 << 20)) != 0;
+  bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+  unsigned long long xcr0 = osAvx ? _xgetbv(0) : 0;
+  bool avxState = (xcr0 & 0x6) == 0x6;
+  bool avx512State = (xcr0 & 0xe6) == 0xe6;
+  bool avx2 = false;
+  bool avx512 = false;
+  if (maxLeaf >= 7) {
+    __cpuidex(info, 7, 0);
+    avx2 = avxState && (info[1] & (1 << 5)) != 0;
+    avx512 = avx512State && (info[1] & (1 << 16)) != 0;
+  }
+  if (avx512) return IsaLevel::Avx512;
+  if (avx2) return IsaLevel::Avx2;
+  if (sse42) return IsaLevel::Sse42;
+  if (sse2) return IsaLevel::Sse2;
+#elif defined(COLLISION_X86_KERNELS)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return IsaLevel::Avx512;
+  if (__builtin_cpu_supports("avx2")) return IsaLevel::Avx2;
+  if (__builtin_cpu_supports("sse4.2")) return IsaLevel::Sse42;
+  if (__builtin_cpu_supports("sse2")) return IsaLevel::Sse2;
+#endif
+  return IsaLevel::Scalar;
+}
+
+static PhysicsKernels tableFor(IsaLevel level) {
+  switch (level) {
+#if defined(COLLISION_X86_KERNELS)
+    case IsaLevel::Avx512: return kernels_avx512::kernelTable();
+    case IsaLevel::Avx2: return kernels_avx2::kernelTable();
+    case IsaLevel::Sse42: return kernels_sse42::kernelTable();
+    case IsaLevel::Sse2: return kernels_sse2::kernelTable();
+#endif
+    default: return kernels_scalar::kernelTable();
+  }
+}
+
+static PhysicsKernels initialKernels() {
+  IsaLevel level = detectIsaLevel();
+
+  const char* forced = std::getenv("COLLISION_ISA");
+  if (forced && *forced) {
+    IsaLevel requested;
+    if (!parseIsaLevel(forced, requested)) {
+      fmt::print(stderr, "Unknown COLLISION_ISA value: {}\n", forced);
+    }
+    else if (requested > level) {
+      fmt::print(stderr, "COLLISION_ISA={} is not supported by this CPU, using {}\n", forced, isaName(level));
+    }
+    else {
+      level = requested;
+    }
+  }
+  return tableFor(level);
+}
+
+static PhysicsKernels& activeKernels() {
+  static PhysicsKernels kernels = initialKernels();
+  return kernels;
+}
+
+const PhysicsKernels& physicsKernels() {
+  return activeKernels();
+}
+
+bool setPhysicsKernels(IsaLevel level) {
+  if (level > detectIsaLevel()) return false;
+  activeKernels() = tableFor(level);
+  return true;
+}
+
+const char* isaName(IsaLevel level) {
+  switch (level) {
+    case IsaLevel::Scalar: return "scalar";
+    case IsaLevel::Sse2: return "sse2";
+    case IsaLevel::Sse42: return "sse42";
+    case IsaLevel::Avx2: return "avx2";
+    case IsaLevel::Avx512: return "avx512";
+  }
+  return "unknown";
+}
+
+bool parseIsaLevel(const char* name, IsaLevel& level) {
+  if (std::strcmp(name, "scalar") == 0) level = IsaLevel::Scalar;
+  else if (std::strcmp(name, "sse2") == 0) level = IsaLevel::Sse2;
+  else if (std::strcmp(name, "sse42") == 0) level = IsaLevel::Sse42;
+  else if (std::strcmp(name, "avx2") == 0) level = IsaLevel::Avx2;
+  else if (std::strcmp(name, "avx512") == 0) level = IsaLevel::Avx512;
+  else return false;
+  return true;
+}
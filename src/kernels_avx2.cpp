@@ -0,0 +1,3 @@
+#define KERNEL_ISA_AVX2
+#define KERNEL_NAMESPACE kernels_avx2
+#include "kernels_impl.h"
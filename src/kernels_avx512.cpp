@@ -0,0 +1,3 @@
+#define KERNEL_ISA_AVX512
+#define KERNEL_NAMESPACE kernels_avx512
+#include "kernels_impl.h"
@@ -0,0 +1,343 @@
+// Body of every kernel table. Each kernels_<isa>.cpp defines one KERNEL_ISA_* macro and
+// KERNEL_NAMESPACE, then includes this file, and CMake compiles it with that ISA's flags.
+// Keep it free of standard library templates: inline functions emitted here would carry the
+// wider instructions and could be picked by the linker for code running on older CPUs.
+#include "kernels.h"
+
+#if defined(KERNEL_ISA_AVX512) || defined(KERNEL_ISA_AVX2)
+#include <immintrin.h>
+#elif defined(KERNEL_ISA_SSE42)
+#include <nmmintrin.h>
+#elif defined(KERNEL_ISA_SSE2)
+#include <emmintrin.h>
+#else
+#include <math.h>
+#endif
+
+namespace KERNEL_NAMESPACE {
+namespace {
+
+// Thin wrappers so each kernel is written once for every vector width.
+// F is a float vector, M a lane mask, I an int32 vector.
+#if defined(KERNEL_ISA_AVX512)
+
+constexpr IsaLevel isa = IsaLevel::Avx512;
+constexpr int width = 16;
+using F = __m512;
+using M = __mmask16;
+using I = __m512i;
+inline F load(const float* p) { return _mm512_loadu_ps(p); }
+inline void store(float* p, F v) { _mm512_storeu_ps(p, v); }
+inline F set1(float v) { return _mm512_set1_ps(v); }
+inline F add(F a, F b) { return _mm512_add_ps(a, b); }
+inline F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+inline F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+inline F div(F a, F b) { return _mm512_div_ps(a, b); }
+inline F sqrt(F a) { return _mm512_sqrt_ps(a); }
+inline F min(F a, F b) { return _mm512_min_ps(a, b); }
+inline F neg(F a) { return _mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(a), _mm512_set1_epi32(INT32_MIN))); }
+inline M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+inline M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+inline M le(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+inline M both(M a, M b) { return static_cast<M>(a & b); }
+inline M differ(M a, M b) { return static_cast<M>(a ^ b); }
+inline F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+inline F keep(M m, F a) { return _mm512_maskz_mov_ps(m, a); }
+inline unsigned bits(M m) { return m; }
+inline F gather(const float* base, const uint32_t* index) {
+  return _mm512_i32gather_ps(_mm512_loadu_si512(index), base, 4);
+}
+inline I toInt(F a) { return _mm512_cvttps_epi32(a); }
+inline I iset1(int32_t v) { return _mm512_set1_epi32(v); }
+inline I imulAdd(I a, I b, I c) { return _mm512_add_epi32(_mm512_mullo_epi32(a, b), c); }
+inline void istore(uint32_t* p, I v) { _mm512_storeu_si512(p, v); }
+
+#elif defined(KERNEL_ISA_AVX2)
+
+constexpr IsaLevel isa = IsaLevel::Avx2;
+constexpr int width = 8;
+using F = __m256;
+using M = __m256;
+using I = __m256i;
+inline F load(const float* p) { return _mm256_loadu_ps(p); }
+inline void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+inline F set1(float v) { return _mm256_set1_ps(v); }
+inline F add(F a, F b) { return _mm256_add_ps(a, b); }
+inline F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+inline F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+inline F div(F a, F b) { return _mm256_div_ps(a, b); }
+inline F sqrt(F a) { return _mm256_sqrt_ps(a); }
+inline F min(F a, F b) { return _mm256_min_ps(a, b); }
+inline F neg(F a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+inline M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline M both(M a, M b) { return _mm256_and_ps(a, b); }
+inline M differ(M a, M b) { return _mm256_xor_ps(a, b); }
+inline F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+inline F keep(M m, F a) { return _mm256_and_ps(m, a); }
+inline unsigned bits(M m) { return static_cast<unsigned>(_mm256_movemask_ps(m)); }
+inline F gather(const float* base, const uint32_t* index) {
+  return _mm256_i32gather_ps(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index)), 4);
+}
+inline I toInt(F a) { return _mm256_cvttps_epi32(a); }
+inline I iset1(int32_t v) { return _mm256_set1_epi32(v); }
+inline I imulAdd(I a, I b, I c) { return _mm256_add_epi32(_mm256_mullo_epi32(a, b), c); }
+inline void istore(uint32_t* p, I v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+
+#elif defined(KERNEL_ISA_SSE42) || defined(KERNEL_ISA_SSE2)
+
+#if defined(KERNEL_ISA_SSE42)
+constexpr IsaLevel isa = IsaLevel::Sse42;
+#else
+constexpr IsaLevel isa = IsaLevel::Sse2;
+#endif
+constexpr int width = 4;
+using F = __m128;
+using M = __m128;
+using I = __m128i;
+inline F load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, F v) { _mm_storeu_ps(p, v); }
+inline F set1(float v) { return _mm_set1_ps(v); }
+inline F add(F a, F b) { return _mm_add_ps(a, b); }
+inline F sub(F a, F b) { return _mm_sub_ps(a, b); }
+inline F mul(F a, F b) { return _mm_mul_ps(a, b); }
+inline F div(F a, F b) { return _mm_div_ps(a, b); }
+inline F sqrt(F a) { return _mm_sqrt_ps(a); }
+inline F min(F a, F b) { return _mm_min_ps(a, b); }
+inline F neg(F a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+inline M lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+inline M gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+inline M le(F a, F b) { return _mm_cmple_ps(a, b); }
+inline M both(M a, M b) { return _mm_and_ps(a, b); }
+inline M differ(M a, M b) { return _mm_xor_ps(a, b); }
+inline F keep(M m, F a) { return _mm_and_ps(m, a); }
+inline unsigned bits(M m) { return static_cast<unsigned>(_mm_movemask_ps(m)); }
+inline F gather(const float* base, const uint32_t* index) {
+  return _mm_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]]);
+}
+inline I toInt(F a) { return _mm_cvttps_epi32(a); }
+inline I iset1(int32_t v) { return _mm_set1_epi32(v); }
+inline void istore(uint32_t* p, I v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+#if defined(KERNEL_ISA_SSE42)
+inline F select(M m, F a, F b) { return _mm_blendv_ps(b, a, m); }
+inline I imulAdd(I a, I b, I c) { return _mm_add_epi32(_mm_mullo_epi32(a, b), c); }
+#else
+inline F select(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+// SSE2 has no 32-bit low multiply, so build it from two 32x32->64 multiplies
+inline I imulAdd(I a, I b, I c) {
+  I even = _mm_mul_epu32(a, b);
+  I odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+  I product = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                 _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+  return _mm_add_epi32(product, c);
+}
+#endif
+
+#else
+
+constexpr IsaLevel isa = IsaLevel::Scalar;
+constexpr int width = 1;
+using F = float;
+using M = bool;
+using I = int32_t;
+inline F load(const float* p) { return *p; }
+inline void store(float* p, F v) { *p = v; }
+inline F set1(float v) { return v; }
+inline F add(F a, F b) { return a + b; }
+inline F sub(F a, F b) { return a - b; }
+inline F mul(F a, F b) { return a * b; }
+inline F div(F a, F b) { return a / b; }
+inline F sqrt(F a) { return ::sqrtf(a); }
+inline F min(F a, F b) { return b < a ? b : a; }
+inline F neg(F a) { return -a; }
+inline M lt(F a, F b) { return a < b; }
+inline M gt(F a, F b) { return a > b; }
+inline M le(F a, F b) { return a <= b; }
+inline M both(M a, M b) { return a && b; }
+inline M differ(M a, M b) { return a != b; }
+inline F select(M m, F a, F b) { return m ? a : b; }
+inline F keep(M m, F a) { return m ? a : 0.0f; }
+inline unsigned bits(M m) { return m ? 1u : 0u; }
+inline F gather(const float* base, const uint32_t* index) { return base[index[0]]; }
+inline I toInt(F a) { return static_cast<int32_t>(a); }
+inline I iset1(int32_t v) { return v; }
+inline I imulAdd(I a, I b, I c) { return a * b + c; }
+inline void istore(uint32_t* p, I v) { *p = static_cast<uint32_t>(v); }
+
+#endif
+
+inline void integrateAxis(float* p, float* v, const float* r, F dt, F lo, F hi) {
+  F rad = load(r);
+  F vel = load(v);
+  F pos = add(load(p), mul(vel, dt));
+  M below = lt(sub(pos, rad), lo);
+  M above = gt(add(pos, rad), hi);
+  pos = select(below, add(lo, rad), pos);
+  pos = select(above, sub(hi, rad), pos);
+  vel = select(differ(below, above), neg(vel), vel);
+  store(p, pos);
+  store(v, vel);
+}
+
+inline void integrateAxisScalar(float& p, float& v, float r, float dt, float lo, float hi) {
+  p += v * dt;
+  bool below = p - r < lo;
+  bool above = p + r > hi;
+  p = below ? lo + r : p;
+  p = above ? hi - r : p;
+  v = (below != above) ? -v : v;
+}
+
+void integrateBounded(float* x, float* y, float* vx, float* vy, const float* radius, size_t count,
+                      float dt, float minBound, float maxBound) {
+  F dtv = set1(dt);
+  F lo = set1(minBound);
+  F hi = set1(maxBound);
+  size_t i = 0;
+  for (; i + width <= count; i += width) {
+    integrateAxis(x + i, vx + i, radius + i, dtv, lo, hi);
+    integrateAxis(y + i, vy + i, radius + i, dtv, lo, hi);
+  }
+  for (; i < count; ++i) {
+    integrateAxisScalar(x[i], vx[i], radius[i], dt, minBound, maxBound);
+    integrateAxisScalar(y[i], vy[i], radius[i], dt, minBound, maxBound);
+  }
+}
+
+void addScaled(float* out, const float* a, const float* b, float scale, size_t count) {
+  F s = set1(scale);
+  size_t i = 0;
+  for (; i + width <= count; i += width) {
+    store(out + i, add(load(a + i), mul(s, load(b + i))));
+  }
+  for (; i < count; ++i) {
+    out[i] = a[i] + scale * b[i];
+  }
+}
+
+inline void splitPairs(const CandidatePair* pairs, uint32_t* a, uint32_t* b) {
+  for (int l = 0; l < width; ++l) {
+    a[l] = pairs[l].a;
+    b[l] = pairs[l].b;
+  }
+}
+
+size_t filterContacts(const float* x, const float* y, const float* radius,
+                      const CandidatePair* pairs, size_t count, CandidatePair* out) {
+  alignas(64) uint32_t ia[width];
+  alignas(64) uint32_t ib[width];
+  size_t kept = 0;
+  size_t i = 0;
+  for (; i + width <= count; i += width) {
+    splitPairs(pairs + i, ia, ib);
+    F dx = sub(gather(x, ia), gather(x, ib));
+    F dy = sub(gather(y, ia), gather(y, ib));
+    F minDist = add(gather(radius, ia), gather(radius, ib));
+    unsigned mask = bits(lt(add(mul(dx, dx), mul(dy, dy)), mul(minDist, minDist)));
+    for (int l = 0; l < width; ++l) {
+      if (mask & (1u << l)) out[kept++] = pairs[i + l];
+    }
+  }
+  for (; i < count; ++i) {
+    uint32_t a = pairs[i].a;
+    uint32_t b = pairs[i].b;
+    float dx = x[a] - x[b];
+    float dy = y[a] - y[b];
+    float minDist = radius[a] + radius[b];
+    if (dx * dx + dy * dy < minDist * minDist) out[kept++] = pairs[i];
+  }
+  return kept;
+}
+
+// Same maths as resolveContact, one contact per lane. Lanes that miss or separate get zero deltas.
+void resolveContactBatch(float* x, float* y, float* vx, float* vy, const float* radius,
+                         const float* invMass, const CandidatePair* batch) {
+  alignas(64) uint32_t ia[width];
+  alignas(64) uint32_t ib[width];
+  splitPairs(batch, ia, ib);
+
+  F xa = gather(x, ia), ya = gather(y, ia), xb = gather(x, ib), yb = gather(y, ib);
+  F vxa = gather(vx, ia), vya = gather(vy, ia), vxb = gather(vx, ib), vyb = gather(vy, ib);
+  F ima = gather(invMass, ia), imb = gather(invMass, ib);
+  F zero = set1(0.0f);
+
+  F dx = sub(xa, xb);
+  F dy = sub(ya, yb);
+  F minDist = add(gather(radius, ia), gather(radius, ib));
+  F distSq = add(mul(dx, dx), mul(dy, dy));
+  M hit = both(lt(distSq, mul(minDist, minDist)), gt(distSq, zero));
+
+  // Coincident circles divide by zero here. Masking the normal keeps the NaN out of every delta.
+  F dist = sqrt(distSq);
+  F nx = keep(hit, div(dx, dist));
+  F ny = keep(hit, div(dy, dist));
+  F relDot = add(mul(sub(vxa, vxb), nx), mul(sub(vya, vyb), ny));
+  hit = both(hit, le(relDot, zero));
+
+  F impulse = keep(hit, div(mul(set1(2.0f), relDot), add(ima, imb)));
+  F jx = mul(impulse, nx);
+  F jy = mul(impulse, ny);
+
+  // Overlap fixer
+  F overlap = keep(hit, mul(set1(0.5f), sub(minDist, dist)));
+  F ox = mul(nx, overlap);
+  F oy = mul(ny, overlap);
+
+  alignas(64) float out[8][width];
+  store(out[0], sub(vxa, mul(jx, ima)));
+  store(out[1], sub(vya, mul(jy, ima)));
+  store(out[2], add(vxb, mul(jx, imb)));
+  store(out[3], add(vyb, mul(jy, imb)));
+  store(out[4], add(xa, ox));
+  store(out[5], add(ya, oy));
+  store(out[6], sub(xb, ox));
+  store(out[7], sub(yb, oy));
+  for (int l = 0; l < width; ++l) {
+    uint32_t a = ia[l];
+    uint32_t b = ib[l];
+    vx[a] = out[0][l]; vy[a] = out[1][l];
+    vx[b] = out[2][l]; vy[b] = out[3][l];
+    x[a] = out[4][l]; y[a] = out[5][l];
+    x[b] = out[6][l]; y[b] = out[7][l];
+  }
+}
+
+void cellKeys(const float* x, const float* y, size_t count, float minX, float minY, float cell,
+              int cols, int rows, uint32_t* out) {
+  F mnx = set1(minX);
+  F mny = set1(minY);
+  F cellv = set1(cell);
+  F lastCol = set1(static_cast<float>(cols - 1));
+  F lastRow = set1(static_cast<float>(rows - 1));
+  I colsv = iset1(cols);
+  size_t i = 0;
+  for (; i + width <= count; i += width) {
+    I cx = toInt(min(div(sub(load(x + i), mnx), cellv), lastCol));
+    I cy = toInt(min(div(sub(load(y + i), mny), cellv), lastRow));
+    istore(out + i, imulAdd(cy, colsv, cx));
+  }
+  for (; i < count; ++i) {
+    float fx = (x[i] - minX) / cell;
+    float fy = (y[i] - minY) / cell;
+    int cx = static_cast<int>(fx < cols - 1 ? fx : static_cast<float>(cols - 1));
+    int cy = static_cast<int>(fy < rows - 1 ? fy : static_cast<float>(rows - 1));
+    out[i] = static_cast<uint32_t>(cy * cols + cx);
+  }
+}
+
+}
+
+PhysicsKernels kernelTable() {
+  PhysicsKernels table;
+  table.isa = isa;
+  table.lanes = width;
+  table.integrateBounded = integrateBounded;
+  table.addScaled = addScaled;
+  table.filterContacts = filterContacts;
+  table.resolveContactBatch = resolveContactBatch;
+  table.cellKeys = cellKeys;
+  return table;
+}
+
+}
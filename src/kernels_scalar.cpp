@@ -0,0 +1,3 @@
+#define KERNEL_ISA_SCALAR
+#define KERNEL_NAMESPACE kernels_scalar
+#include "kernels_impl.h"
@@ -0,0 +1,3 @@
+#define KERNEL_ISA_SSE2
+#define KERNEL_NAMESPACE kernels_sse2
+#include "kernels_impl.h"
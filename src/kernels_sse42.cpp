@@ -0,0 +1,3 @@
+#define KERNEL_ISA_SSE42
+#define KERNEL_NAMESPACE kernels_sse42
+#include "kernels_impl.h"
@@ -1,11 +1,17 @@
 #include "shader.h"
 #include "buffer_utils.h"
+#include "instance_ring.h"
 #include "circle.h"
+#include "simulation_thread.h"
+#include "world.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <vector>
 #include <cmath>
 #include <string>
+#include <thread>
 #include <fmt/core.h>
 
 #include <glad/glad.h>
@@ -23,9 +29,17 @@ float scale = 1.0f / 2.54f; // Scaling the units so that 1.0f normalized coords
 // Prototypes
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
-// Vector containing circles
-std::vector<Circle> circles;
+// Simulation state, stepped on its own thread at a fixed 120 Hz once the window is up
+World world;
+SimulationThread simulation(world, 1.0f / 120.0f, 8);
+// Broadphase last asked of the simulation, B cycles from here
+BroadphaseKind broadphase = BroadphaseKind::UniformGrid;
+
+// Blended circle positions, only the runs that moved are rewritten each frame
+std::vector<float> instanceData;
+size_t instanceCount = 0;
 
 // Drag Globals
 bool isDragging = false;
@@ -33,7 +47,7 @@ float dragStartX = 0.0f;
 float dragStartY = 0.0f;
 
 // Instance buffer for circle positions
-GLuint instanceVBO;
+InstanceRing instances;
 
 int main() {
     // GLFW Boilerplate
@@ -59,6 +73,7 @@ int main() {
     // Callbacks here
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     // Window icon
     int iconWidth, iconHeight, iconChannels;
@@ -113,23 +128,13 @@ int main() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    // Upload instanced positions of all circles to the GPU
-    glGenBuffers(1, &instanceVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-
-    std::vector<float> instanceData;
-    instanceData.reserve(circles.size() * 2);
-
-    for (const Circle& c : circles) {
-        instanceData.push_back(c.x);
-        instanceData.push_back(c.y);
-    }
-
-    glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(float), instanceData.data(), GL_DYNAMIC_DRAW);
+    // Instanced positions of all circles stream through a ring of three regions, the first snapshot fills it
+    instances.create();
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    instances.bindAttribute(1);
     glVertexAttribDivisor(1, 1);
     glBindVertexArray(0);
+    if (instances.persistent()) fmt::print("Circle instances go through a persistently mapped buffer.\n");
 
     GLuint circleShaderProgram = compileShaderProgram(
         "../shaders/circle_vertex.glsl",
@@ -141,58 +146,30 @@ int main() {
     GLuint aspectLoc = glGetUniformLocation(circleShaderProgram, "aspectRatio");
     float aspect = (float)currentWidth / (float)currentHeight;
 
-    // Setup for delta time
-    float prevTime = glfwGetTime();
+    // Physics runs on its own thread, rendering blends between the last two steps it published.
+    // From here on the world is only changed through commands it applies at the start of a step.
+    world.setThreadCount(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+    simulation.start();
 
     // Frame loop
     while (!glfwWindowShouldClose(window)) {
-        float currentTime = glfwGetTime();
-        float deltaTime = currentTime - prevTime;
-        prevTime = currentTime;
-        if (!circles.empty()) {
-            for (Circle& circle : circles) {
-                circle.x += circle.vx * deltaTime;
-                circle.y += circle.vy * deltaTime;
-            }
-            
-            for (size_t i = 0; i < circles.size(); ++i) {
-                for (size_t j = i + 1; j < circles.size(); ++j) {
-                    circles[i].applyCollision(circles[j]);
-                }
-            }
-
-            for (Circle& circle : circles) {
-                // Left and right borders
-                if (circle.x - circle.radius < -1.0f) {
-                    circle.x = -1.0f + circle.radius;
-                    circle.vx = -circle.vx;
-                }
-                if (circle.x + circle.radius > 1.0f) {
-                    circle.x = 1.0f - circle.radius;
-                    circle.vx = -circle.vx;
-                }
-                
-                // Top and bottom borders
-                if (circle.y - circle.radius < -1.0f) {
-                    circle.y = -1.0f + circle.radius;
-                    circle.vy = -circle.vy;
-                }
-                if (circle.y + circle.radius > 1.0f) {
-                    circle.y = 1.0f - circle.radius;
-                    circle.vy = -circle.vy;
-                }
-            }
+        simulation.update();
+        const InstanceSnapshot& snapshot = simulation.snapshot();
+        if (snapshot.count != instanceCount) {
+            // The snapshot covers every circle whenever the count changes
+            instanceCount = snapshot.count;
+            instanceData.resize(instanceCount * 2);
+        }
 
-            std::vector<float> instanceData;
-            instanceData.reserve(circles.size() * 2);
-            for (const Circle& c : circles) {
-                instanceData.push_back(c.x);
-                instanceData.push_back(c.y);
+        // Only circles that moved are blended and uploaded, sleeping ones keep what the GPU has
+        double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        float alpha = snapshot.alpha(now);
+        for (const BodyRange& range : snapshot.ranges) {
+            for (size_t i = range.begin * 2; i < range.end * 2; ++i) {
+                instanceData[i] = snapshot.previous[i] + (snapshot.current[i] - snapshot.previous[i]) * alpha;
             }
-            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, instanceData.size() * sizeof(float), instanceData.data());
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
         }
+        instances.upload(instanceData.data(), instanceCount, snapshot.ranges);
         glClear(GL_COLOR_BUFFER_BIT);
 
         // Update aspect ratio
@@ -208,12 +185,16 @@ int main() {
         glUseProgram(circleShaderProgram);
         glUniform1f(aspectLoc, aspect);
         glBindVertexArray(circleVAO);
-        glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, templateCircleVertices.size() / 3, circles.size());
+        instances.bindAttribute(1);
+        glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, templateCircleVertices.size() / 3, instanceCount);
+        instances.fence();
         glBindVertexArray(0);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    simulation.stop();
+    instances.destroy();
     glfwTerminate();
     return 0;
 }
@@ -243,20 +224,28 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
         double dx = dragStartX - x_ndc;
         double dy = dragStartY - y_ndc;
 
-        circles.emplace_back(dragStartX, dragStartY, dx * 2.0f, dy * 2.0f, 0.08f, 1.0f);
-
-        std::vector<float> instanceData;
-        instanceData.reserve(circles.size() * 2);
-        for (const Circle& c : circles) {
-            instanceData.push_back(c.x);
-            instanceData.push_back(c.y);
+        // The new circle shows up in the next snapshot the simulation publishes
+        if (!world.submit(Command::spawn(Circle(dragStartX, dragStartY, dx * 2.0f, dy * 2.0f, 0.08f, 1.0f)))) {
+            fmt::print(stderr, "Command queue full, circle dropped.\n");
+            return;
         }
-        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-        glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(float), instanceData.data(), GL_DYNAMIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         fmt::print("Spawned a circle at X: {} Y: {}\n", x_ndc, y_ndc);
         fmt::print("Velocity X: {}\n", dx * 2.0f);
         fmt::print("Velocity Y: {}\n", dy * 2.0f);
     }
+}
+
+// Keyboard callback function
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    // B cycles through the broadphases so they can be compared live
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        broadphase = static_cast<BroadphaseKind>((static_cast<int>(broadphase) + 1) % broadphaseKindCount);
+        world.submit(Command::setBroadphase(broadphase));
+        fmt::print("Broadphase: {}\n", broadphaseName(broadphase));
+    }
+    // R removes every circle
+    if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+        world.submit(Command::reset());
+    }
 }
\ No newline at end of file
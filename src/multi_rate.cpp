@@ -0,0 +1,257 @@
+#include "multi_rate.h"
+#include "job_system.h"
+#include "kernels.h"
+#include "narrowphase.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+// Substeps circle i needs this step as a level: 2^level substeps, 0 for a single step
+static int levelFor(const CircleWorld& bodies, size_t i, float dt, const MultiRateSettings& settings) {
+  float fastAt = settings.threshold * bodies.radius[i];
+  float movesSq = (bodies.vx[i] * bodies.vx[i] + bodies.vy[i] * bodies.vy[i]) * dt * dt;
+  if (!(movesSq > fastAt * fastAt)) return 0;
+  // Each level halves the distance, a quarter of the squared distance
+  float allowed = settings.courant * bodies.radius[i];
+  return std::clamp(static_cast<int>(std::ceil(0.5f * std::log2(movesSq / (allowed * allowed)))), 1, settings.maxLevels);
+}
+
+// Extent on one axis of a circle at p moving at v for dt, with the part past a wall folded back
+static void sweptRange(float p, float v, float radius, float dt, float& lo, float& hi) {
+  float end = p + v * dt;
+  lo = std::min(p, end);
+  hi = std::max(p, end);
+  if (end > 1.0f - radius) {
+    hi = 1.0f - radius;
+    lo = std::min(lo, 2.0f * (1.0f - radius) - end);
+  }
+  if (end < radius - 1.0f) {
+    lo = radius - 1.0f;
+    hi = std::max(hi, 2.0f * (radius - 1.0f) - end);
+  }
+  lo -= radius;
+  hi += radius;
+}
+
+// Squared distance from (px, py) to the segment from (ax, ay) to (ax + dx, ay + dy)
+static float segmentDistanceSq(float px, float py, float ax, float ay, float dx, float dy) {
+  float lengthSq = dx * dx + dy * dy;
+  float t = lengthSq > 0.0f ? std::clamp(((px - ax) * dx + (py - ay) * dy) / lengthSq, 0.0f, 1.0f) : 0.0f;
+  float ox = ax + dx * t - px;
+  float oy = ay + dy * t - py;
+  return ox * ox + oy * oy;
+}
+
+// Whether circle i, moving for dt, can touch fast circle j anywhere along j's path this step. The part
+// of the path folded back by a wall is tested by mirroring i across that wall instead.
+static bool meetsPath(const CircleWorld& bodies, uint32_t j, size_t i, float dt) {
+  float rj = bodies.radius[j];
+  float dx = bodies.vx[j] * dt;
+  float dy = bodies.vy[j] * dt;
+  float endX = bodies.x[j] + dx;
+  float endY = bodies.y[j] + dy;
+  float speed = std::sqrt(bodies.vx[i] * bodies.vx[i] + bodies.vy[i] * bodies.vy[i]);
+  float reach = rj + bodies.radius[i] + speed * dt;
+
+  float xs[2] = {bodies.x[i], bodies.x[i]};
+  float ys[2] = {bodies.y[i], bodies.y[i]};
+  if (endX > 1.0f - rj) xs[1] = 2.0f * (1.0f - rj) - xs[0];
+  else if (endX < rj - 1.0f) xs[1] = 2.0f * (rj - 1.0f) - xs[0];
+  if (endY > 1.0f - rj) ys[1] = 2.0f * (1.0f - rj) - ys[0];
+  else if (endY < rj - 1.0f) ys[1] = 2.0f * (rj - 1.0f) - ys[0];
+  for (float px : xs) {
+    for (float py : ys) {
+      if (segmentDistanceSq(px, py, bodies.x[j], bodies.y[j], dx, dy) <= reach * reach) return true;
+    }
+  }
+  return false;
+}
+
+size_t MultiRate::prepare(const CircleWorld& bodies, const uint8_t* awake, float dt, const MultiRateSettings& settings,
+                          JobSystem* jobs) {
+  stepDt = dt;
+  finest = 0;
+  finestSteps = 1;
+  fast.clear();
+  sleepers.clear();
+  active.clear();
+  size_t n = bodies.size();
+  if (!settings.enabled || n == 0 || settings.maxLevels <= 0) return 0;
+
+  std::atomic<size_t> fastCount{0};
+  auto scan = [&](size_t begin, size_t end, unsigned) {
+    size_t found = 0;
+    for (size_t i = begin; i < end; ++i) {
+      found += awake[i] && levelFor(bodies, i, dt, settings) > 0;
+    }
+    if (found > 0) fastCount.fetch_add(found, std::memory_order_relaxed);
+  };
+  if (jobs) jobs->parallelFor(n, 16384, scan);
+  else scan(0, n, 0);
+  size_t activeLimit = static_cast<size_t>(settings.maxActiveFraction * static_cast<float>(n));
+  if (fastCount.load() == 0 || fastCount.load() > activeLimit) return 0;
+
+  level.assign(n, 0);
+  float slack = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    slack = std::max(slack, std::max(std::fabs(bodies.vx[i]), std::fabs(bodies.vy[i])) * dt + bodies.radius[i]);
+    if (!awake[i]) continue;
+    level[i] = static_cast<uint8_t>(levelFor(bodies, i, dt, settings));
+    if (level[i] > 0) fast.push_back(static_cast<uint32_t>(i));
+  }
+  buildReachGrid(bodies, slack);
+
+  // Everything that can touch a fast circle's path moves on that circle's level, the swept boxes are
+  // only a first cut. Reaches are bucketed widened by the largest swept box, so the cell under a
+  // circle's centre lists them all.
+  // Counting as circles join stops the pass as soon as too many would be substepped.
+  size_t activeCount = fast.size();
+  for (size_t i = 0; i < n && activeCount <= activeLimit; ++i) {
+    float px = bodies.x[i];
+    float py = bodies.y[i];
+    if (px < reachBounds.minX || px > reachBounds.maxX || py < reachBounds.minY || py > reachBounds.maxY) continue;
+    Aabb box{};
+    sweptRange(px, bodies.vx[i], bodies.radius[i], dt, box.minX, box.maxX);
+    sweptRange(py, bodies.vy[i], bodies.radius[i], dt, box.minY, box.maxY);
+    auto consider = [&](uint32_t f) {
+      uint32_t j = fast[f];
+      if (j == i || !reach[f].overlaps(box) || !meetsPath(bodies, j, i, dt)) return;
+      if (!awake[i]) {
+        sleepers.push_back(CandidatePair{std::min<uint32_t>(j, i), std::max<uint32_t>(j, i)});
+        return;
+      }
+      if (level[i] == 0) activeCount++;
+      level[i] = std::max(level[i], reachLevel[f]);
+    };
+    int cx, cy, unused;
+    reachRange(px, px, cx, unused);
+    reachRange(py, py, cy, unused);
+    size_t c = static_cast<size_t>(cy) * cols + cx;
+    for (uint32_t e = cellStart[c]; e < cellStart[c + 1]; ++e) {
+      consider(cellEntries[e]);
+    }
+    for (uint32_t f : oversized) {
+      consider(f);
+    }
+  }
+
+  if (activeCount > activeLimit) {
+    fast.clear();
+    sleepers.clear();
+    return 0;
+  }
+
+  // Gather by level, counting sort style
+  levelStart.assign(settings.maxLevels + 2, 0);
+  for (size_t i = 0; i < n; ++i) {
+    if (level[i] > 0) levelStart[level[i] + 1]++;
+  }
+  for (int l = 0; l <= settings.maxLevels; ++l) {
+    levelStart[l + 1] += levelStart[l];
+    if (levelStart[l + 1] > levelStart[l]) finest = l;
+  }
+  active.resize(levelStart[settings.maxLevels + 1]);
+  cursor.assign(levelStart.begin(), levelStart.end() - 1);
+  for (size_t i = 0; i < n; ++i) {
+    if (level[i] > 0) active[cursor[level[i]]++] = static_cast<uint32_t>(i);
+  }
+
+  local.clear();
+  local.reserve(active.size());
+  for (uint32_t i : active) {
+    local.x.push_back(bodies.x[i]);
+    local.y.push_back(bodies.y[i]);
+    local.vx.push_back(bodies.vx[i]);
+    local.vy.push_back(bodies.vy[i]);
+    local.radius.push_back(bodies.radius[i]);
+    local.invMass.push_back(bodies.invMass[i]);
+  }
+  finestSteps = size_t(1) << finest;
+  return active.size();
+}
+
+void MultiRate::finish(CircleWorld& bodies) {
+  if (active.empty()) return;
+  if (!localBroadphase) localBroadphase = createBroadphase(BroadphaseKind::UniformGrid);
+
+  // Contacts are resolved every finest substep, each level moves once its substep is over
+  const PhysicsKernels& kernels = physicsKernels();
+  for (size_t s = 0; s < finestSteps; ++s) {
+    localBroadphase->findPairs(local, pairs);
+    resolvePairs(local, pairs.data(), pairs.size());
+    for (int l = 1; l <= finest; ++l) {
+      size_t begin = levelStart[l];
+      size_t count = levelStart[l + 1] - begin;
+      size_t stride = size_t(1) << (finest - l);
+      if (count == 0 || (s + 1) % stride != 0) continue;
+      kernels.integrateBounded(local.x.data() + begin, local.y.data() + begin, local.vx.data() + begin,
+                               local.vy.data() + begin, local.radius.data() + begin, count,
+                               stepDt / static_cast<float>(size_t(1) << l), -1.0f, 1.0f);
+    }
+  }
+
+  for (size_t k = 0; k < active.size(); ++k) {
+    uint32_t i = active[k];
+    bodies.x[i] = local.x[k];
+    bodies.y[i] = local.y[k];
+    bodies.vx[i] = local.vx[k];
+    bodies.vy[i] = local.vy[k];
+  }
+}
+
+void MultiRate::reachRange(float lo, float hi, int& first, int& last) const {
+  first = std::clamp(static_cast<int>(std::floor((lo + 1.0f) / cell)), 0, cols - 1);
+  last = std::clamp(static_cast<int>(std::floor((hi + 1.0f) / cell)), 0, cols - 1);
+}
+
+// A fast circle's reach is its swept box with wall bounces folded in. One deflected by a neighbour can
+// leave it, whatever it then meets is resolved by the ordinary contact pass next step.
+void MultiRate::buildReachGrid(const CircleWorld& bodies, float slack) {
+  reach.clear();
+  reachLevel.clear();
+  for (uint32_t i : fast) {
+    reachLevel.push_back(level[i]);
+    Aabb box{};
+    sweptRange(bodies.x[i], bodies.vx[i], bodies.radius[i], stepDt, box.minX, box.maxX);
+    sweptRange(bodies.y[i], bodies.vy[i], bodies.radius[i], stepDt, box.minY, box.maxY);
+    reach.push_back(box);
+  }
+  reachBounds = Aabb{reach[0].minX - slack, reach[0].minY - slack, reach[0].maxX + slack, reach[0].maxY + slack};
+  for (const Aabb& box : reach) {
+    reachBounds.minX = std::min(reachBounds.minX, box.minX - slack);
+    reachBounds.minY = std::min(reachBounds.minY, box.minY - slack);
+    reachBounds.maxX = std::max(reachBounds.maxX, box.maxX + slack);
+    reachBounds.maxY = std::max(reachBounds.maxY, box.maxY + slack);
+  }
+
+  cols = std::clamp(static_cast<int>(std::sqrt(static_cast<double>(fast.size())) * 2.0), 1, 64);
+  cell = 2.0f / static_cast<float>(cols);
+  const int maxCells = 64;
+  size_t cellCount = static_cast<size_t>(cols) * cols;
+  cellStart.assign(cellCount + 1, 0);
+  oversized.clear();
+  auto forEachCell = [&](size_t f, auto&& visit) {
+    int cx0, cx1, cy0, cy1;
+    reachRange(reach[f].minX - slack, reach[f].maxX + slack, cx0, cx1);
+    reachRange(reach[f].minY - slack, reach[f].maxY + slack, cy0, cy1);
+    if ((cx1 - cx0 + 1) * (cy1 - cy0 + 1) > maxCells) return false;
+    for (int cy = cy0; cy <= cy1; ++cy) {
+      for (int cx = cx0; cx <= cx1; ++cx) {
+        visit(static_cast<size_t>(cy) * cols + cx);
+      }
+    }
+    return true;
+  };
+
+  for (size_t f = 0; f < reach.size(); ++f) {
+    if (!forEachCell(f, [&](size_t c) { cellStart[c + 1]++; })) oversized.push_back(static_cast<uint32_t>(f));
+  }
+  for (size_t c = 0; c < cellCount; ++c) {
+    cellStart[c + 1] += cellStart[c];
+  }
+  cellEntries.resize(cellStart[cellCount]);
+  cursor.assign(cellStart.begin(), cellStart.end() - 1);
+  for (size_t f = 0; f < reach.size(); ++f) {
+    forEachCell(f, [&](size_t c) { cellEntries[cursor[c]++] = static_cast<uint32_t>(f); });
+  }
+}
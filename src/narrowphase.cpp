@@ -0,0 +1,91 @@
+#include "narrowphase.h"
+#include "kernels.h"
+#include <cmath>
+
+bool applyElasticImpulse(CircleWorld& bodies, uint32_t a, uint32_t b, float nx, float ny) {
+  float relDot = (bodies.vx[a] - bodies.vx[b]) * nx + (bodies.vy[a] - bodies.vy[b]) * ny;
+  if (relDot > 0) return false;
+
+  float invMassA = bodies.invMass[a];
+  float invMassB = bodies.invMass[b];
+  float impulse = (2 * relDot) / (invMassA + invMassB);
+  bodies.vx[a] -= impulse * invMassA * nx;
+  bodies.vy[a] -= impulse * invMassA * ny;
+  bodies.vx[b] += impulse * invMassB * nx;
+  bodies.vy[b] += impulse * invMassB * ny;
+  return true;
+}
+
+void resolveContact(CircleWorld& bodies, uint32_t a, uint32_t b) {
+  float dx = bodies.x[a] - bodies.x[b];
+  float dy = bodies.y[a] - bodies.y[b];
+  float minDist = bodies.radius[a] + bodies.radius[b];
+  float distSq = dx * dx + dy * dy;
+  if (distSq >= minDist * minDist || distSq <= 0.0f) return;
+
+  float dist = std::sqrt(distSq);
+  float nx = dx / dist;
+  float ny = dy / dist;
+  if (!applyElasticImpulse(bodies, a, b, nx, ny)) return;
+
+  // Overlap fixer
+  float overlap = 0.5f * (minDist - dist);
+  bodies.x[a] += nx * overlap;
+  bodies.y[a] += ny * overlap;
+  bodies.x[b] -= nx * overlap;
+  bodies.y[b] -= ny * overlap;
+}
+
+void resolvePairs(CircleWorld& bodies, const CandidatePair* pairs, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    resolveContact(bodies, pairs[i].a, pairs[i].b);
+  }
+}
+
+void resolvePairsBatched(CircleWorld& bodies, const CandidatePair* pairs, size_t count, NarrowphaseScratch& scratch) {
+  const PhysicsKernels& kernels = physicsKernels();
+  scratch.contacts.resize(count);
+  size_t contactCount = kernels.filterContacts(bodies.x.data(), bodies.y.data(), bodies.radius.data(),
+                                               pairs, count, scratch.contacts.data());
+  scratch.contacts.resize(contactCount);
+
+  size_t lanes = kernels.lanes;
+  if (lanes == 1) {
+    resolvePairs(bodies, scratch.contacts.data(), contactCount);
+    return;
+  }
+
+  if (scratch.stamp.size() < bodies.size()) scratch.stamp.resize(bodies.size(), 0);
+
+  // Each pass packs contacts into batches where no body appears twice. A contact that would
+  // share a body with its batch waits for the next pass, so lanes never race on a write.
+  CandidatePair batch[16];
+  std::vector<CandidatePair>& pending = scratch.contacts;
+  std::vector<CandidatePair>& deferred = scratch.deferred;
+  while (!pending.empty()) {
+    deferred.clear();
+    size_t filled = 0;
+    uint32_t current = scratch.nextBatch();
+
+    for (const CandidatePair& pair : pending) {
+      if (scratch.stamp[pair.a] == current || scratch.stamp[pair.b] == current) {
+        deferred.push_back(pair);
+        continue;
+      }
+      scratch.stamp[pair.a] = current;
+      scratch.stamp[pair.b] = current;
+      batch[filled++] = pair;
+
+      if (filled == lanes) {
+        kernels.resolveContactBatch(bodies.x.data(), bodies.y.data(), bodies.vx.data(), bodies.vy.data(),
+                                    bodies.radius.data(), bodies.invMass.data(), batch);
+        filled = 0;
+        current = scratch.nextBatch();
+      }
+    }
+
+    // Scalar tail for the partial batch
+    resolvePairs(bodies, batch, filled);
+    pending.swap(deferred);
+  }
+}
@@ -0,0 +1,154 @@
+#include "parallel_pipeline.h"
+#include "kernels.h"
+#include "narrowphase.h"
+#include "job_system.h"
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int lowestBit(uint64_t value) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+size_t ParallelPipeline::resolveCollisions(CircleWorld& bodies, Broadphase& broadphase, JobSystem& jobs) {
+  size_t pairTests = findContacts(bodies, broadphase, jobs);
+  clearMasks(bodies.size(), jobs);
+  colorContacts(jobs);
+  resolveColors(bodies, jobs);
+  return pairTests;
+}
+
+size_t ParallelPipeline::findContacts(const CircleWorld& bodies, Broadphase& broadphase, JobSystem& jobs) {
+  broadphase.findPairsParallel(bodies, jobs, chunks);
+
+  size_t pairTests = 0;
+  for (const std::vector<CandidatePair>& chunk : chunks) {
+    pairTests += chunk.size();
+  }
+
+  // Keep only touching pairs, filtering each chunk in place
+  const PhysicsKernels& kernels = physicsKernels();
+  jobs.parallelFor(chunks.size(), 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t c = begin; c < end; ++c) {
+      std::vector<CandidatePair>& chunk = chunks[c];
+      chunk.resize(kernels.filterContacts(bodies.x.data(), bodies.y.data(), bodies.radius.data(),
+                                          chunk.data(), chunk.size(), chunk.data()));
+    }
+  });
+  return pairTests;
+}
+
+void ParallelPipeline::clearMasks(size_t bodyCount, JobSystem& jobs) {
+  if (maskCapacity < bodyCount) {
+    maskCapacity = std::max(bodyCount, maskCapacity * 2);
+    colorMasks.reset(new std::atomic<uint64_t>[maskCapacity]);
+  }
+  jobs.parallelFor(bodyCount, 16384, [&](size_t begin, size_t end, unsigned) {
+    for (size_t i = begin; i < end; ++i) {
+      colorMasks[i].store(0, std::memory_order_relaxed);
+    }
+  });
+}
+
+void ParallelPipeline::colorContacts(JobSystem& jobs) {
+  // Greedy colouring: a contact takes the lowest colour free at both bodies. A colour is claimed by
+  // setting its bit on each body with fetch_or, so two contacts sharing a body can never both win it.
+  size_t chunkCount = chunks.size();
+  chunkColors.resize(chunkCount);
+  chunkOffsets.resize(chunkCount);
+  jobs.parallelFor(chunkCount, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t c = begin; c < end; ++c) {
+      const std::vector<CandidatePair>& chunk = chunks[c];
+      std::vector<uint8_t>& colors = chunkColors[c];
+      std::vector<size_t>& counts = chunkOffsets[c];
+      colors.resize(chunk.size());
+      counts.assign(maxColors + 1, 0);
+
+      for (size_t i = 0; i < chunk.size(); ++i) {
+        std::atomic<uint64_t>& maskA = colorMasks[chunk[i].a];
+        std::atomic<uint64_t>& maskB = colorMasks[chunk[i].b];
+        uint64_t taken = maskA.load(std::memory_order_relaxed) | maskB.load(std::memory_order_relaxed);
+        int color = maxColors;
+        while (~taken != 0) {
+          int candidate = lowestBit(~taken);
+          uint64_t bit = uint64_t(1) << candidate;
+          uint64_t oldA = maskA.fetch_or(bit, std::memory_order_relaxed);
+          if (oldA & bit) {
+            taken |= oldA;
+            continue;
+          }
+          uint64_t oldB = maskB.fetch_or(bit, std::memory_order_relaxed);
+          if (oldB & bit) {
+            maskA.fetch_and(~bit, std::memory_order_relaxed);
+            taken |= oldB;
+            continue;
+          }
+          color = candidate;
+          break;
+        }
+        colors[i] = static_cast<uint8_t>(color);
+        counts[color]++;
+      }
+    }
+  });
+
+  // Turn per chunk counts into write offsets into one array sorted by colour
+  size_t total = 0;
+  usedColors = 0;
+  for (int color = 0; color <= maxColors; ++color) {
+    colorStart[color] = total;
+    for (size_t c = 0; c < chunkCount; ++c) {
+      size_t count = chunkOffsets[c][color];
+      chunkOffsets[c][color] = total;
+      total += count;
+    }
+    if (color < maxColors && total > colorStart[color]) usedColors = color + 1;
+  }
+  colorStart[maxColors + 1] = total;
+
+  sorted.resize(total);
+  jobs.parallelFor(chunkCount, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t c = begin; c < end; ++c) {
+      std::vector<size_t>& cursor = chunkOffsets[c];
+      for (size_t i = 0; i < chunks[c].size(); ++i) {
+        sorted[cursor[chunkColors[c][i]]++] = chunks[c][i];
+      }
+    }
+  });
+}
+
+void ParallelPipeline::resolveColors(CircleWorld& bodies, JobSystem& jobs) {
+  const PhysicsKernels& kernels = physicsKernels();
+  size_t lanes = kernels.lanes;
+  size_t grain = lanes * 64;
+
+  for (int color = 0; color < maxColors; ++color) {
+    size_t first = colorStart[color];
+    size_t count = colorStart[color + 1] - first;
+    if (count == 0) continue;
+
+    // Contacts within a colour are body-disjoint, so any slice of them is a valid SIMD batch
+    const CandidatePair* contacts = sorted.data() + first;
+    jobs.parallelFor(count, grain, [&](size_t begin, size_t end, unsigned) {
+      size_t i = begin;
+      if (lanes > 1) {
+        for (; i + lanes <= end; i += lanes) {
+          kernels.resolveContactBatch(bodies.x.data(), bodies.y.data(), bodies.vx.data(), bodies.vy.data(),
+                                      bodies.radius.data(), bodies.invMass.data(), contacts + i);
+        }
+      }
+      resolvePairs(bodies, contacts + i, end - i);
+    });
+  }
+
+  // Contacts that found no free colour, rare outside of extreme piles
+  resolvePairs(bodies, sorted.data() + colorStart[maxColors], colorStart[maxColors + 1] - colorStart[maxColors]);
+}
@@ -0,0 +1,487 @@
+#include "sharded_sim.h"
+#include "kernels.h"
+#include "narrowphase.h"
+#include "uniform_grid.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fmt/core.h>
+
+// Everything about a circle that crosses a process boundary, in host byte order since every
+// process runs on the same machine
+struct WireBody {
+  uint32_t id;
+  float x, y, vx, vy, radius, invMass;
+};
+
+struct ShardSetup {
+  uint32_t shard;
+  uint32_t bodyCount;
+  float minX, maxX;
+  float halo;
+  float dt;
+  uint64_t steps;
+  uint32_t linkLatencyMicros;
+};
+
+struct StepReport {
+  uint64_t pairTests;
+  uint64_t haloBytes;
+  uint32_t haloMessages;
+  uint32_t migrations;
+  uint32_t ghosts;
+  double exchangeSeconds;
+  double computeSeconds;
+};
+
+static double seconds() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool writeAll(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t written = send(fd, p, size, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    p += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+static bool readAll(int fd, void* data, size_t size) {
+  char* p = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t got = read(fd, p, size);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) return false;
+    p += got;
+    size -= static_cast<size_t>(got);
+  }
+  return true;
+}
+
+// Messages are a 32 bit byte count followed by the bytes
+static bool sendMessage(int fd, const std::vector<char>& payload) {
+  uint32_t size = static_cast<uint32_t>(payload.size());
+  return writeAll(fd, &size, sizeof(size)) && writeAll(fd, payload.data(), payload.size());
+}
+
+static bool receiveMessage(int fd, std::vector<char>& payload) {
+  uint32_t size = 0;
+  if (!readAll(fd, &size, sizeof(size))) return false;
+  payload.resize(size);
+  return readAll(fd, payload.data(), size);
+}
+
+template <typename T>
+static void append(std::vector<char>& out, const T& value) {
+  const char* p = reinterpret_cast<const char*>(&value);
+  out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+static T extract(const std::vector<char>& in, size_t& offset) {
+  T value;
+  std::memcpy(&value, in.data() + offset, sizeof(T));
+  offset += sizeof(T);
+  return value;
+}
+
+// Sends one framed message to every peer while reading one from each. Both directions advance
+// together under poll, so two neighbours sending halos larger than the socket buffer to each other
+// cannot deadlock.
+struct Peer {
+  int fd = -1;
+  std::vector<char> out;
+  std::vector<char> in;
+  size_t sent = 0;
+  size_t received = 0;
+  uint32_t expected = 0;
+};
+
+static bool exchange(std::vector<Peer>& peers) {
+  std::vector<pollfd> fds;
+  for (Peer& peer : peers) {
+    uint32_t size = static_cast<uint32_t>(peer.out.size());
+    peer.out.insert(peer.out.begin(), reinterpret_cast<const char*>(&size), reinterpret_cast<const char*>(&size) + sizeof(size));
+    peer.sent = 0;
+    peer.received = 0;
+    peer.in.resize(sizeof(uint32_t));
+  }
+
+  for (;;) {
+    fds.clear();
+    for (Peer& peer : peers) {
+      short events = 0;
+      if (peer.sent < peer.out.size()) events |= POLLOUT;
+      if (peer.received < peer.in.size()) events |= POLLIN;
+      // A finished peer may already have hung up, poll skips negative descriptors
+      fds.push_back(pollfd{events != 0 ? peer.fd : -1, events, 0});
+    }
+    bool pending = false;
+    for (const pollfd& fd : fds) pending |= fd.fd >= 0;
+    if (!pending) break;
+
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    for (size_t i = 0; i < peers.size(); ++i) {
+      Peer& peer = peers[i];
+      if (fds[i].revents & (POLLERR | POLLNVAL)) return false;
+      if (fds[i].revents & POLLOUT) {
+        ssize_t written = send(peer.fd, peer.out.data() + peer.sent, peer.out.size() - peer.sent, MSG_NOSIGNAL);
+        if (written < 0 && errno != EAGAIN && errno != EINTR) return false;
+        if (written > 0) peer.sent += static_cast<size_t>(written);
+      }
+      if (fds[i].revents & (POLLIN | POLLHUP)) {
+        ssize_t got = read(peer.fd, peer.in.data() + peer.received, peer.in.size() - peer.received);
+        if (got == 0) return false;
+        if (got < 0 && errno != EAGAIN && errno != EINTR) return false;
+        if (got > 0) peer.received += static_cast<size_t>(got);
+        // Header done, grow to the full message
+        if (peer.received == sizeof(uint32_t) && peer.in.size() == sizeof(uint32_t)) {
+          std::memcpy(&peer.expected, peer.in.data(), sizeof(uint32_t));
+          peer.in.resize(sizeof(uint32_t) + peer.expected);
+        }
+      }
+    }
+  }
+
+  for (Peer& peer : peers) {
+    peer.in.erase(peer.in.begin(), peer.in.begin() + sizeof(uint32_t));
+  }
+  return true;
+}
+
+static void appendBody(std::vector<char>& out, const CircleWorld& circles, const std::vector<uint32_t>& ids, size_t i) {
+  append(out, WireBody{ids[i], circles.x[i], circles.y[i], circles.vx[i], circles.vy[i], circles.radius[i], circles.invMass[i]});
+}
+
+static void pushBody(CircleWorld& circles, std::vector<uint32_t>& ids, const WireBody& body) {
+  ids.push_back(body.id);
+  circles.x.push_back(body.x);
+  circles.y.push_back(body.y);
+  circles.vx.push_back(body.vx);
+  circles.vy.push_back(body.vy);
+  circles.radius.push_back(body.radius);
+  circles.invMass.push_back(body.invMass);
+}
+
+static void truncate(CircleWorld& circles, std::vector<uint32_t>& ids, size_t count) {
+  ids.resize(count);
+  circles.x.resize(count);
+  circles.y.resize(count);
+  circles.vx.resize(count);
+  circles.vy.resize(count);
+  circles.radius.resize(count);
+  circles.invMass.resize(count);
+}
+
+// One shard process: owned circles lead the local arrays, ghosts follow them during a step
+static int runWorker(int coordinator, int leftFd, int rightFd) {
+  std::vector<char> message;
+  if (!receiveMessage(coordinator, message)) return 1;
+  size_t offset = 0;
+  ShardSetup setup = extract<ShardSetup>(message, offset);
+
+  CircleWorld local;
+  std::vector<uint32_t> ids;
+  for (uint32_t i = 0; i < setup.bodyCount; ++i) {
+    pushBody(local, ids, extract<WireBody>(message, offset));
+  }
+
+  std::vector<Peer> peers;
+  int leftPeer = -1, rightPeer = -1;
+  if (leftFd >= 0) {
+    leftPeer = static_cast<int>(peers.size());
+    peers.emplace_back();
+    peers.back().fd = leftFd;
+  }
+  if (rightFd >= 0) {
+    rightPeer = static_cast<int>(peers.size());
+    peers.emplace_back();
+    peers.back().fd = rightFd;
+  }
+  for (Peer& peer : peers) {
+    fcntl(peer.fd, F_SETFL, fcntl(peer.fd, F_GETFL) | O_NONBLOCK);
+  }
+
+  const PhysicsKernels& kernels = physicsKernels();
+  UniformGrid grid;
+  std::vector<CandidatePair> pairs, crossing;
+  NarrowphaseScratch scratch;
+  std::vector<WireBody> migrants, ghosts;
+  std::vector<char> outMigrants[2], outGhosts[2];
+
+  for (uint64_t step = 0; step < setup.steps; ++step) {
+    double start = seconds();
+    StepReport report{};
+
+    // Sort owned circles into staying, leaving, and near a border
+    for (int side = 0; side < 2; ++side) {
+      outMigrants[side].clear();
+      outGhosts[side].clear();
+    }
+    migrants.clear();
+    size_t kept = 0;
+    size_t owned = ids.size();
+    for (size_t i = 0; i < owned; ++i) {
+      float x = local.x[i];
+      int leaving = x < setup.minX && leftPeer >= 0 ? 0 : x >= setup.maxX && rightPeer >= 0 ? 1 : -1;
+      if (leaving >= 0) {
+        appendBody(outMigrants[leaving], local, ids, i);
+        // Still within reach of this strip, so it stays around as a ghost for this step
+        if (x >= setup.minX - setup.halo && x < setup.maxX + setup.halo) {
+          migrants.push_back(WireBody{ids[i], local.x[i], local.y[i], local.vx[i], local.vy[i], local.radius[i], local.invMass[i]});
+        }
+        report.migrations++;
+        continue;
+      }
+      if (leftPeer >= 0 && x < setup.minX + setup.halo) appendBody(outGhosts[0], local, ids, i);
+      if (rightPeer >= 0 && x >= setup.maxX - setup.halo) appendBody(outGhosts[1], local, ids, i);
+      if (kept != i) {
+        ids[kept] = ids[i];
+        local.x[kept] = local.x[i];
+        local.y[kept] = local.y[i];
+        local.vx[kept] = local.vx[i];
+        local.vy[kept] = local.vy[i];
+        local.radius[kept] = local.radius[i];
+        local.invMass[kept] = local.invMass[i];
+      }
+      kept++;
+    }
+    truncate(local, ids, kept);
+
+    for (int side = 0; side < 2; ++side) {
+      int peer = side == 0 ? leftPeer : rightPeer;
+      if (peer < 0) continue;
+      std::vector<char>& out = peers[peer].out;
+      out.clear();
+      append(out, static_cast<uint32_t>(outMigrants[side].size() / sizeof(WireBody)));
+      out.insert(out.end(), outMigrants[side].begin(), outMigrants[side].end());
+      out.insert(out.end(), outGhosts[side].begin(), outGhosts[side].end());
+      report.haloBytes += out.size() + sizeof(uint32_t);
+      report.haloMessages++;
+    }
+
+    double computed = seconds();
+    double exchangeStart = computed;
+    if (!peers.empty()) {
+      if (setup.linkLatencyMicros > 0) std::this_thread::sleep_for(std::chrono::microseconds(setup.linkLatencyMicros));
+      if (!exchange(peers)) return 1;
+    }
+    double exchanged = seconds();
+
+    // Arrivals join the owned circles, ghosts are appended after them for this step only
+    ghosts.clear();
+    for (Peer& peer : peers) {
+      size_t at = 0;
+      uint32_t arriving = extract<uint32_t>(peer.in, at);
+      for (uint32_t i = 0; i < arriving; ++i) {
+        pushBody(local, ids, extract<WireBody>(peer.in, at));
+      }
+      while (at + sizeof(WireBody) <= peer.in.size()) {
+        ghosts.push_back(extract<WireBody>(peer.in, at));
+      }
+    }
+    owned = ids.size();
+    for (const WireBody& ghost : ghosts) pushBody(local, ids, ghost);
+    for (const WireBody& ghost : migrants) pushBody(local, ids, ghost);
+    report.ghosts = static_cast<uint32_t>(ghosts.size());
+
+    grid.findPairs(local, pairs);
+    report.pairTests = pairs.size();
+
+    // Contacts across a border go first, in world id order, so both workers start them from the same
+    // ghost data and reach the same result for both circles. Inner contacts follow in SIMD batches.
+    crossing.clear();
+    size_t inner = 0;
+    for (const CandidatePair& pair : pairs) {
+      bool ghostA = pair.a >= owned;
+      bool ghostB = pair.b >= owned;
+      if (ghostA && ghostB) continue;
+      if (ghostA || ghostB) crossing.push_back(pair);
+      else pairs[inner++] = pair;
+    }
+    std::sort(crossing.begin(), crossing.end(), [&](const CandidatePair& l, const CandidatePair& r) {
+      uint32_t lLow = std::min(ids[l.a], ids[l.b]), rLow = std::min(ids[r.a], ids[r.b]);
+      if (lLow != rLow) return lLow < rLow;
+      return std::max(ids[l.a], ids[l.b]) < std::max(ids[r.a], ids[r.b]);
+    });
+    for (const CandidatePair& pair : crossing) {
+      // Keep the lower id first so both workers apply the impulse in the same direction
+      if (ids[pair.a] < ids[pair.b]) resolveContact(local, pair.a, pair.b);
+      else resolveContact(local, pair.b, pair.a);
+    }
+    resolvePairsBatched(local, pairs.data(), inner, scratch);
+
+    // Ghost results belong to their owners, who worked them out from the same data
+    truncate(local, ids, owned);
+    kernels.integrateBounded(local.x.data(), local.y.data(), local.vx.data(), local.vy.data(), local.radius.data(),
+                             owned, setup.dt, -1.0f, 1.0f);
+
+    double end = seconds();
+    report.exchangeSeconds = exchanged - exchangeStart;
+    report.computeSeconds = (computed - start) + (end - exchanged);
+    if (!writeAll(coordinator, &report, sizeof(report))) return 1;
+  }
+
+  message.clear();
+  for (size_t i = 0; i < ids.size(); ++i) {
+    appendBody(message, local, ids, i);
+  }
+  return sendMessage(coordinator, message) ? 0 : 1;
+}
+
+bool runSharded(CircleWorld& circles, const ShardSettings& settings, ShardStats& stats) {
+  size_t shardCount = std::max<size_t>(settings.shards, 1);
+  float maxRadius = 0.0f;
+  for (float r : circles.radius) maxRadius = std::max(maxRadius, r);
+  float halo = 2.0f * maxRadius;
+  float width = 2.0f / static_cast<float>(shardCount);
+  // Ghosts from both sides of a strip must never touch, or the two workers would disagree on them
+  if (width < 2.0f * halo) {
+    fmt::print(stderr, "Strips of {} are narrower than twice the halo of {}, use fewer shards.\n", width, halo);
+    return false;
+  }
+
+  // One socket to each worker for setup and reports, one between each pair of neighbours
+  std::vector<int> coordinatorFds(shardCount, -1), workerFds(shardCount, -1);
+  std::vector<int> leftFds(shardCount, -1), rightFds(shardCount, -1);
+  auto closeAll = [&] {
+    for (std::vector<int>* fds : {&coordinatorFds, &workerFds, &leftFds, &rightFds}) {
+      for (int& fd : *fds) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+      }
+    }
+  };
+  for (size_t s = 0; s < shardCount; ++s) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+      closeAll();
+      return false;
+    }
+    coordinatorFds[s] = pair[0];
+    workerFds[s] = pair[1];
+    if (s + 1 < shardCount) {
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        closeAll();
+        return false;
+      }
+      rightFds[s] = pair[0];
+      leftFds[s + 1] = pair[1];
+    }
+  }
+
+  double start = seconds();
+  std::vector<pid_t> workers;
+  for (size_t s = 0; s < shardCount; ++s) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      for (pid_t worker : workers) kill(worker, SIGTERM);
+      for (pid_t worker : workers) waitpid(worker, nullptr, 0);
+      closeAll();
+      return false;
+    }
+    if (pid == 0) {
+      // Keep only this shard's own sockets
+      for (size_t other = 0; other < shardCount; ++other) {
+        close(coordinatorFds[other]);
+        if (other != s) {
+          close(workerFds[other]);
+          if (leftFds[other] >= 0) close(leftFds[other]);
+          if (rightFds[other] >= 0) close(rightFds[other]);
+        }
+      }
+      _exit(runWorker(workerFds[s], leftFds[s], rightFds[s]));
+    }
+    workers.push_back(pid);
+  }
+  for (size_t s = 0; s < shardCount; ++s) {
+    close(workerFds[s]);
+    workerFds[s] = -1;
+    if (leftFds[s] >= 0) close(leftFds[s]);
+    if (rightFds[s] >= 0) close(rightFds[s]);
+    leftFds[s] = rightFds[s] = -1;
+  }
+
+  bool ok = true;
+  std::vector<uint32_t> allIds(circles.size());
+  for (size_t i = 0; i < circles.size(); ++i) allIds[i] = static_cast<uint32_t>(i);
+  for (size_t s = 0; s < shardCount && ok; ++s) {
+    float minX = -1.0f + width * static_cast<float>(s);
+    float maxX = s + 1 == shardCount ? 1.0f : minX + width;
+    std::vector<char> message(sizeof(ShardSetup));
+    uint32_t count = 0;
+    for (size_t i = 0; i < circles.size(); ++i) {
+      float x = circles.x[i];
+      bool inside = (s == 0 || x >= minX) && (s + 1 == shardCount || x < maxX);
+      if (!inside) continue;
+      appendBody(message, circles, allIds, i);
+      count++;
+    }
+    ShardSetup setup{static_cast<uint32_t>(s), count, minX, maxX, halo, settings.dt,
+                     static_cast<uint64_t>(settings.steps), settings.linkLatencyMicros};
+    std::memcpy(message.data(), &setup, sizeof(setup));
+    ok = sendMessage(coordinatorFds[s], message);
+  }
+
+  // Workers report every step, read them in lockstep so none blocks on a full socket
+  for (size_t step = 0; step < settings.steps && ok; ++step) {
+    for (size_t s = 0; s < shardCount && ok; ++s) {
+      StepReport report;
+      ok = readAll(coordinatorFds[s], &report, sizeof(report));
+      if (!ok) break;
+      stats.pairTests += report.pairTests;
+      stats.haloBytes += report.haloBytes;
+      stats.haloMessages += report.haloMessages;
+      stats.migrations += report.migrations;
+      stats.ghosts += report.ghosts;
+      stats.exchangeSeconds += report.exchangeSeconds;
+      stats.computeSeconds += report.computeSeconds;
+    }
+  }
+
+  size_t gathered = 0;
+  for (size_t s = 0; s < shardCount && ok; ++s) {
+    std::vector<char> message;
+    ok = receiveMessage(coordinatorFds[s], message);
+    for (size_t at = 0; ok && at + sizeof(WireBody) <= message.size();) {
+      WireBody body = extract<WireBody>(message, at);
+      circles.x[body.id] = body.x;
+      circles.y[body.id] = body.y;
+      circles.vx[body.id] = body.vx;
+      circles.vy[body.id] = body.vy;
+      gathered++;
+    }
+  }
+  stats.wallSeconds = seconds() - start;
+
+  if (!ok) {
+    for (pid_t worker : workers) kill(worker, SIGTERM);
+  }
+  for (pid_t worker : workers) {
+    int status = 0;
+    waitpid(worker, &status, 0);
+    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  closeAll();
+  if (ok && gathered != circles.size()) {
+    fmt::print(stderr, "Shards returned {} circles, expected {}.\n", gathered, circles.size());
+    ok = false;
+  }
+  return ok;
+}
@@ -0,0 +1,401 @@
+#include "barnes_hut.h"
+#include "event_driven.h"
+#include "kernels.h"
+#include "world.h"
+#if defined(COLLISION_SHARDED_SIM)
+#include "sharded_sim.h"
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <fmt/core.h>
+
+// Headless batch runner: builds a world from the command line, steps it and reports throughput.
+
+enum class VelocityDistribution { Zero, Uniform, Gaussian };
+enum class NBodyMode { Off, Direct, BarnesHut };
+enum class SimMode { Steps, Events };
+
+struct SimOptions {
+  size_t bodies = 1000;
+  float radius = 0.01f;
+  float mass = 1.0f;
+  VelocityDistribution velocity = VelocityDistribution::Uniform;
+  float speed = 0.5f;
+  size_t fast = 0;
+  size_t steps = 1000;
+  float dt = 1.0f / 60.0f;
+  unsigned seed = 1;
+  BroadphaseKind broadphase = BroadphaseKind::UniformGrid;
+  unsigned threads = 1;
+  bool sleep = true;
+  bool ccd = true;
+  bool adaptive = false;
+  bool multiRate = false;
+  float courant = AdaptiveStepSettings{}.courant;
+  bool iterativeSolver = false;
+  unsigned iterations = 8;
+  IntegratorKind integrator = IntegratorKind::SemiImplicitEuler;
+  float gravity = 0.0f;
+  NBodyMode nbody = NBodyMode::Off;
+  float theta = 0.5f;
+  SimMode mode = SimMode::Steps;
+  size_t domains = 0;
+  size_t shards = 0;
+  unsigned linkLatency = 0;
+};
+
+static void printUsage() {
+  fmt::print(stderr,
+    "Usage: collision_sim [options]\n"
+    "  --bodies N          Number of circles (default 1000)\n"
+    "  --radius R          Circle radius in world units (default 0.01)\n"
+    "  --mass M            Circle mass (default 1)\n"
+    "  --velocity KIND     zero | uniform | gaussian (default uniform)\n"
+    "  --speed S           Max speed for uniform, sigma for gaussian (default 0.5)\n"
+    "  --fast N            Launch N of the circles 20 times faster (default 0)\n"
+    "  --steps N           Number of steps to run, or snapshots to take in events mode (default 1000)\n"
+    "  --dt T              Step size, or time between snapshots in events mode, in seconds (default 1/60)\n"
+    "  --mode KIND         steps | events, fixed steps or exact event driven hard disks (default steps)\n"
+    "  --seed N            Random seed (default 1)\n"
+    "  --broadphase KIND   brute | grid | sap | tree (default grid)\n"
+    "  --integrator KIND   euler | symplectic | verlet | rk4 (default symplectic)\n"
+    "  --gravity G         Downward acceleration, 0 lets circles coast (default 0)\n"
+    "  --nbody KIND        off | direct | bh, mutual gravity between circles (default off)\n"
+    "  --theta T           Barnes-Hut opening angle, 0 is exact (default 0.5)\n"
+    "  --threads N         Worker threads including the main one (default 1)\n"
+    "  --sleep on|off      Let resting islands sleep (default on)\n"
+    "  --ccd on|off        Sweep fast circles so they cannot pass through others (default on)\n"
+    "  --adaptive on|off   Size each step from circle speeds and contact depth, covering steps * dt seconds (default off)\n"
+    "  --courant C         Fraction of its radius a circle may move in one adaptive step or substep (default 0.25)\n"
+    "  --multirate on|off  Substep only fast circles and their neighbours (default off)\n"
+    "  --solver KIND       impulse | iterative, one impulse per contact or warm started passes (default impulse)\n"
+    "  --iterations N      Velocity passes per step for the iterative solver (default 8)\n"
+    "  --domains N         Split collisions into N load balanced strips, needs --threads > 1 (default off)\n"
+#if defined(COLLISION_SHARDED_SIM)
+    "  --shards N          Run N worker processes that swap halos over sockets (default off)\n"
+    "  --link-latency US   Delay added to every halo message in sharded runs (default 0)\n"
+#endif
+    );
+}
+
+static bool parseArgs(int argc, char** argv, SimOptions& options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") return false;
+    if (i + 1 >= argc) {
+      fmt::print(stderr, "Missing value for {}\n", arg);
+      return false;
+    }
+    std::string value = argv[++i];
+
+    if (arg == "--bodies") options.bodies = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--radius") options.radius = std::strtof(value.c_str(), nullptr);
+    else if (arg == "--mass") options.mass = std::strtof(value.c_str(), nullptr);
+    else if (arg == "--speed") options.speed = std::strtof(value.c_str(), nullptr);
+    else if (arg == "--fast") options.fast = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--steps") options.steps = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--dt") options.dt = std::strtof(value.c_str(), nullptr);
+    else if (arg == "--shards") options.shards = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--link-latency") options.linkLatency = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    else if (arg == "--domains") options.domains = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--threads") options.threads = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    else if (arg == "--iterations") options.iterations = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    else if (arg == "--seed") options.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    else if (arg == "--broadphase") {
+      if (!parseBroadphaseKind(value, options.broadphase)) {
+        fmt::print(stderr, "Unknown broadphase: {}\n", value);
+        return false;
+      }
+    }
+    else if (arg == "--gravity") options.gravity = std::strtof(value.c_str(), nullptr);
+    else if (arg == "--theta") options.theta = std::strtof(value.c_str(), nullptr);
+    else if (arg == "--mode") {
+      if (value == "steps") options.mode = SimMode::Steps;
+      else if (value == "events") options.mode = SimMode::Events;
+      else {
+        fmt::print(stderr, "Unknown mode: {}\n", value);
+        return false;
+      }
+    }
+    else if (arg == "--nbody") {
+      if (value == "off") options.nbody = NBodyMode::Off;
+      else if (value == "direct") options.nbody = NBodyMode::Direct;
+      else if (value == "bh") options.nbody = NBodyMode::BarnesHut;
+      else {
+        fmt::print(stderr, "Unknown n-body mode: {}\n", value);
+        return false;
+      }
+    }
+    else if (arg == "--integrator") {
+      if (!parseIntegratorKind(value, options.integrator)) {
+        fmt::print(stderr, "Unknown integrator: {}\n", value);
+        return false;
+      }
+    }
+    else if (arg == "--courant") options.courant = std::strtof(value.c_str(), nullptr);
+    else if (arg == "--sleep" || arg == "--ccd" || arg == "--adaptive" || arg == "--multirate") {
+      bool& flag = arg == "--sleep" ? options.sleep
+                 : arg == "--ccd" ? options.ccd
+                 : arg == "--adaptive" ? options.adaptive
+                 : options.multiRate;
+      if (value == "on") flag = true;
+      else if (value == "off") flag = false;
+      else {
+        fmt::print(stderr, "Expected on or off for {}, got {}\n", arg, value);
+        return false;
+      }
+    }
+    else if (arg == "--solver") {
+      if (value == "impulse") options.iterativeSolver = false;
+      else if (value == "iterative") options.iterativeSolver = true;
+      else {
+        fmt::print(stderr, "Unknown solver: {}\n", value);
+        return false;
+      }
+    }
+    else if (arg == "--velocity") {
+      if (value == "zero") options.velocity = VelocityDistribution::Zero;
+      else if (value == "uniform") options.velocity = VelocityDistribution::Uniform;
+      else if (value == "gaussian") options.velocity = VelocityDistribution::Gaussian;
+      else {
+        fmt::print(stderr, "Unknown velocity distribution: {}\n", value);
+        return false;
+      }
+    }
+    else {
+      fmt::print(stderr, "Unknown option: {}\n", arg);
+      return false;
+    }
+  }
+
+  if (options.courant <= 0.0f) {
+    fmt::print(stderr, "Courant must be positive.\n");
+    return false;
+  }
+  if (options.radius <= 0.0f || options.radius >= 1.0f || options.mass <= 0.0f || options.dt <= 0.0f) {
+    fmt::print(stderr, "Radius must be in (0, 1), mass and dt must be positive.\n");
+    return false;
+  }
+  if (options.nbody != NBodyMode::Off && options.gravity != 0.0f) {
+    fmt::print(stderr, "Use either --gravity or --nbody, not both.\n");
+    return false;
+  }
+  if (options.mode == SimMode::Events && (options.nbody != NBodyMode::Off || options.gravity != 0.0f)) {
+    fmt::print(stderr, "Events mode has no forces, circles fly straight between collisions.\n");
+    return false;
+  }
+  if (options.theta < 0.0f) {
+    fmt::print(stderr, "Theta must not be negative.\n");
+    return false;
+  }
+  return true;
+}
+
+// Lays circles out on a square lattice inside the box so a run starts without overlaps when it can.
+static void populateWorld(World& world, const SimOptions& options) {
+  if (options.bodies == 0) return;
+  std::mt19937 rng(options.seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::normal_distribution<float> normal(0.0f, options.speed);
+
+  size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(options.bodies))));
+  float spacing = (2.0f - 2.0f * options.radius) / static_cast<float>(side);
+  if (spacing < 2.0f * options.radius) {
+    fmt::print(stderr, "Warning: {} bodies of radius {} do not fit without overlapping.\n", options.bodies, options.radius);
+  }
+
+  for (size_t i = 0; i < options.bodies; ++i) {
+    float x = -1.0f + options.radius + spacing * (static_cast<float>(i % side) + 0.5f);
+    float y = -1.0f + options.radius + spacing * (static_cast<float>(i / side) + 0.5f);
+
+    float vx = 0.0f;
+    float vy = 0.0f;
+    if (options.velocity == VelocityDistribution::Uniform) {
+      float angle = unit(rng) * 2.0f * static_cast<float>(M_PI);
+      float speed = unit(rng) * options.speed;
+      vx = std::cos(angle) * speed;
+      vy = std::sin(angle) * speed;
+    }
+    else if (options.velocity == VelocityDistribution::Gaussian) {
+      vx = normal(rng);
+      vy = normal(rng);
+    }
+    // The fast circles are spread evenly through the lattice
+    if ((i * options.fast) / options.bodies != ((i + 1) * options.fast) / options.bodies) {
+      float angle = unit(rng) * 2.0f * static_cast<float>(M_PI);
+      vx = std::cos(angle) * 20.0f * options.speed;
+      vy = std::sin(angle) * 20.0f * options.speed;
+    }
+
+    world.addCircle(Circle(x, y, vx, vy, options.radius, options.mass));
+  }
+}
+
+// Runs the circles through the event driven engine, taking a snapshot every dt as a renderer would
+static int runEvents(const SimOptions& options) {
+  World world;
+  populateWorld(world, options);
+  EventDrivenSim events;
+  events.reset(world.circles());
+  fmt::print("Simulating {} bodies event by event, {} snapshots {} s apart\n", world.size(), options.steps, options.dt);
+
+  size_t snapshots = 0;
+  auto start = std::chrono::steady_clock::now();
+  events.sample(options.dt, options.steps, [&](double, const CircleWorld&) { snapshots++; });
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  const EventStats& stats = events.stats();
+  uint64_t handled = stats.collisions + stats.wallBounces + stats.cellCrossings;
+  fmt::print("Wall time:       {:.3f} s\n", seconds);
+  fmt::print("Snapshots/sec:   {:.1f}\n", seconds > 0.0 ? snapshots / seconds : 0.0);
+  fmt::print("Events/sec:      {:.4g}\n", seconds > 0.0 ? handled / seconds : 0.0);
+  fmt::print("Events:          {} collisions, {} wall bounces, {} cell crossings, {} stale\n", stats.collisions,
+    stats.wallBounces, stats.cellCrossings, stats.staleEvents);
+  return 0;
+}
+
+#if defined(COLLISION_SHARDED_SIM)
+static int runShards(const SimOptions& options) {
+  // Worker processes are forked, so the world stays single threaded here
+  World world;
+  populateWorld(world, options);
+  CircleWorld circles = world.circles();
+  fmt::print("Simulating {} bodies for {} steps in {} shard processes (dt = {}, link latency = {} us)\n",
+    circles.size(), options.steps, options.shards, options.dt, options.linkLatency);
+
+  ShardSettings settings;
+  settings.shards = options.shards;
+  settings.steps = options.steps;
+  settings.dt = options.dt;
+  settings.linkLatencyMicros = options.linkLatency;
+  ShardStats stats;
+  if (!runSharded(circles, settings, stats)) {
+    fmt::print(stderr, "Sharded run failed.\n");
+    return 1;
+  }
+
+  double busy = stats.exchangeSeconds + stats.computeSeconds;
+  fmt::print("Wall time:       {:.3f} s\n", stats.wallSeconds);
+  fmt::print("Steps/sec:       {:.1f}\n", stats.wallSeconds > 0.0 ? options.steps / stats.wallSeconds : 0.0);
+  fmt::print("Pair tests/sec:  {:.4g}\n", stats.wallSeconds > 0.0 ? stats.pairTests / stats.wallSeconds : 0.0);
+  fmt::print("Halo exchange:   {:.1f}% of shard time, {:.0f} bytes and {:.1f} ghosts per step\n",
+    busy > 0.0 ? 100.0 * stats.exchangeSeconds / busy : 0.0,
+    options.steps > 0 ? static_cast<double>(stats.haloBytes) / options.steps : 0.0,
+    options.steps > 0 ? static_cast<double>(stats.ghosts) / options.steps : 0.0);
+  fmt::print("Migrations:      {}\n", stats.migrations);
+  return 0;
+}
+#endif
+
+int main(int argc, char** argv) {
+  SimOptions options;
+  if (!parseArgs(argc, argv, options)) {
+    printUsage();
+    return 1;
+  }
+  if (options.mode == SimMode::Events) return runEvents(options);
+#if defined(COLLISION_SHARDED_SIM)
+  if (options.shards > 0) return runShards(options);
+#endif
+
+  World world;
+  world.setBroadphase(options.broadphase);
+  world.setThreadCount(options.threads);
+  world.setDomainCount(options.domains);
+  SleepSettings sleep = world.sleepSettings();
+  sleep.enabled = options.sleep;
+  world.setSleepSettings(sleep);
+  SolverSettings solver = world.solverSettings();
+  solver.enabled = options.iterativeSolver;
+  solver.iterations = options.iterations;
+  world.setSolverSettings(solver);
+  world.setIntegrator(options.integrator);
+  CcdSettings ccd = world.ccdSettings();
+  ccd.enabled = options.ccd;
+  world.setCcdSettings(ccd);
+  AdaptiveStepSettings adaptive = world.adaptiveStepSettings();
+  adaptive.courant = options.courant;
+  world.setAdaptiveStepSettings(adaptive);
+  MultiRateSettings multiRate = world.multiRateSettings();
+  multiRate.enabled = options.multiRate;
+  multiRate.courant = options.courant;
+  multiRate.threshold = ccd.motionThreshold;
+  world.setMultiRateSettings(multiRate);
+  if (options.gravity != 0.0f) world.setForceField(std::make_unique<UniformField>(0.0f, -options.gravity));
+  if (options.nbody == NBodyMode::Direct) world.setForceField(std::make_unique<PairwiseGravity>());
+  if (options.nbody == NBodyMode::BarnesHut) world.setForceField(std::make_unique<BarnesHutGravity>(options.theta));
+  populateWorld(world, options);
+  fmt::print("Simulating {} bodies for {} steps (dt = {}, broadphase = {}, kernels = {}, threads = {})\n",
+    world.size(), options.steps, options.dt, broadphaseName(options.broadphase), isaName(physicsKernels().isa),
+    world.threadCount());
+
+  auto start = std::chrono::steady_clock::now();
+  float smallestStep = options.dt;
+  float largestStep = options.dt;
+  if (options.adaptive) {
+    // The same stretch of simulated time as the fixed steps would cover, in as many steps as it takes
+    double remaining = static_cast<double>(options.steps) * options.dt;
+    smallestStep = adaptive.maxStep;
+    largestStep = 0.0f;
+    while (remaining > 1e-6) {
+      float dt = world.stepAdaptive(static_cast<float>(remaining));
+      if (dt <= 0.0f) break;
+      remaining -= dt;
+      if (world.stats().dtLimit != StepLimit::Requested) smallestStep = std::min(smallestStep, dt);
+      largestStep = std::max(largestStep, dt);
+    }
+  }
+  else {
+    for (size_t i = 0; i < options.steps; ++i) {
+      world.step(options.dt);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  const WorldStats& stats = world.stats();
+  double stepsPerSecond = seconds > 0.0 ? stats.steps / seconds : 0.0;
+  double pairTestsPerSecond = seconds > 0.0 ? stats.pairTests / seconds : 0.0;
+
+  fmt::print("Wall time:       {:.3f} s\n", seconds);
+  fmt::print("Steps/sec:       {:.1f}\n", stepsPerSecond);
+  fmt::print("Pair tests/sec:  {:.4g}\n", pairTestsPerSecond);
+  fmt::print("Sleeping bodies: {}\n", world.sleepingCount());
+  fmt::print("Swept bodies:    {} over the run\n", stats.sweptBodies);
+  if (options.multiRate) {
+    fmt::print("Substepped:      {} bodies over the run, {:.1f} per step\n", stats.substeppedBodies,
+      stats.steps > 0 ? static_cast<double>(stats.substeppedBodies) / stats.steps : 0.0);
+  }
+  if (options.adaptive) {
+    fmt::print("Step sizes:      {:.3g} to {:.3g} s, {:.3g} on average over {:.3g} s\n", smallestStep, largestStep,
+      stats.steps > 0 ? stats.time / stats.steps : 0.0, stats.time);
+    std::string limits;
+    for (int k = 0; k < stepLimitCount; ++k) {
+      if (stats.limitedSteps[k] == 0) continue;
+      if (!limits.empty()) limits += ", ";
+      limits += fmt::format("{} {}", stepLimitName(static_cast<StepLimit>(k)), stats.limitedSteps[k]);
+    }
+    fmt::print("Limited by:      {}\n", limits);
+  }
+  if (world.forceField()) {
+    fmt::print("Integrator:      {}\n", integratorName(world.integratorKind()));
+  }
+  if (options.iterativeSolver) {
+    const ContactSolver& contacts = world.contactSolver();
+    fmt::print("Contacts:        {} in the last step, {} warm started\n", contacts.contactCount(), contacts.warmStartedCount());
+  }
+  if (const DomainDecomposition* domains = world.domainDecomposition()) {
+    size_t ghosts = 0;
+    for (size_t d = 0; d < domains->domainCount(); ++d) {
+      ghosts += domains->ghostCount(d);
+    }
+    fmt::print("Domains:         {} (imbalance {:.2f}, {} ghosts)\n", domains->domainCount(), domains->imbalance(), ghosts);
+  }
+  return 0;
+}
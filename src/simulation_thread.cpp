@@ -0,0 +1,67 @@
+#include "simulation_thread.h"
+#include <algorithm>
+#include <chrono>
+
+static double steadySeconds() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+float InstanceSnapshot::alpha(double now) const {
+  if (stepSize <= 0.0f) return 1.0f;
+  return std::clamp(static_cast<float>((now - time) / stepSize), 0.0f, 1.0f);
+}
+
+SimulationThread::SimulationThread(World& world, float stepSize, int maxStepsPerFrame)
+  : world(world), timestep(stepSize, maxStepsPerFrame) {}
+
+SimulationThread::~SimulationThread() {
+  stop();
+}
+
+void SimulationThread::start() {
+  if (thread.joinable()) return;
+  stopping = false;
+  thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+  if (!thread.joinable()) return;
+  stopping = true;
+  thread.join();
+}
+
+void SimulationThread::run() {
+  double last = steadySeconds();
+  while (!stopping) {
+    double now = steadySeconds();
+    int steps = timestep.advance(world, static_cast<float>(now - last));
+    last = now;
+
+    // Hold on to new positions until the reader has taken the last ones, the stale flags in the
+    // world keep collecting whatever moves in the meantime
+    if ((steps > 0 || world.size() != publishedCount) && snapshots.consumed()) publish();
+
+    double wait = timestep.step() * (1.0f - timestep.alpha());
+    std::this_thread::sleep_until(std::chrono::steady_clock::now() + std::chrono::duration<double>(wait));
+  }
+}
+
+void SimulationThread::publish() {
+  InstanceSnapshot& snapshot = snapshots.back();
+  size_t n = world.size();
+  snapshot.current.resize(n * 2);
+  snapshot.previous.resize(n * 2);
+  world.packInstanceRanges(snapshot.current.data(), 1.0f, snapshot.ranges);
+  if (n != publishedCount) {
+    // Circles were added or removed, the reader has to upload everything
+    world.packInstances(snapshot.current.data());
+    snapshot.ranges.assign(n > 0 ? 1 : 0, BodyRange{0, n});
+  }
+  world.packPreviousInstances(snapshot.previous.data(), snapshot.ranges);
+
+  snapshot.count = n;
+  snapshot.time = steadySeconds();
+  snapshot.stepSize = timestep.step();
+  publishedCount = n;
+  snapshots.publish();
+}
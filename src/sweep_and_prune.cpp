@@ -0,0 +1,86 @@
+#include "sweep_and_prune.h"
+#include "job_system.h"
+#include <algorithm>
+
+// More new intervals than this in one step are sorted in outright, insertion sort would pay for each
+// of them across the whole list
+static constexpr size_t insertionLimit = 8;
+
+// Intervals always cover circles 0 to intervals.size() - 1, the ones added since the last step have
+// none yet. The top interval belongs to last, unless last was added since the last step. Either way
+// it takes over id i: bounds are refreshed from the id every step, so a rename only costs order.
+void SweepAndPrune::circleRemoved(uint32_t i, uint32_t) {
+  if (i >= intervals.size()) return;
+  uint32_t top = static_cast<uint32_t>(intervals.size() - 1);
+  intervals.erase(std::find_if(intervals.begin(), intervals.end(), [&](const Interval& interval) { return interval.id == i; }));
+  if (i == top) return;
+  for (Interval& interval : intervals) {
+    if (interval.id != top) continue;
+    interval.id = i;
+    break;
+  }
+}
+
+void SweepAndPrune::refresh(const CircleWorld& circles) {
+  // Removals that were not reported leave ids that no longer line up, so the order starts over
+  if (intervals.size() > circles.size()) intervals.clear();
+
+  size_t added = circles.size() - intervals.size();
+  for (size_t i = intervals.size(); i < circles.size(); ++i) {
+    intervals.push_back(Interval{0.0f, 0.0f, 0.0f, 0.0f, static_cast<uint32_t>(i)});
+  }
+
+  for (Interval& interval : intervals) {
+    uint32_t id = interval.id;
+    interval.minX = circles.x[id] - circles.radius[id];
+    interval.maxX = circles.x[id] + circles.radius[id];
+    interval.minY = circles.y[id] - circles.radius[id];
+    interval.maxY = circles.y[id] + circles.radius[id];
+  }
+
+  if (added > insertionLimit) {
+    std::sort(intervals.begin(), intervals.end(), [](const Interval& a, const Interval& b) { return a.minX < b.minX; });
+    return;
+  }
+
+  // Insertion sort, cheap when last step's order is nearly right
+  for (size_t i = 1; i < intervals.size(); ++i) {
+    Interval current = intervals[i];
+    size_t j = i;
+    while (j > 0 && intervals[j - 1].minX > current.minX) {
+      intervals[j] = intervals[j - 1];
+      --j;
+    }
+    intervals[j] = current;
+  }
+}
+
+void SweepAndPrune::sweep(size_t begin, size_t end, std::vector<CandidatePair>& pairs) const {
+  for (size_t i = begin; i < end; ++i) {
+    const Interval& a = intervals[i];
+    for (size_t j = i + 1; j < intervals.size() && intervals[j].minX <= a.maxX; ++j) {
+      const Interval& b = intervals[j];
+      if (b.minY > a.maxY || b.maxY < a.minY) continue;
+      pairs.push_back(a.id < b.id ? CandidatePair{a.id, b.id} : CandidatePair{b.id, a.id});
+    }
+  }
+}
+
+void SweepAndPrune::findPairs(const CircleWorld& circles, std::vector<CandidatePair>& pairs) {
+  pairs.clear();
+  refresh(circles);
+  sweep(0, intervals.size(), pairs);
+}
+
+// The insertion sort stays serial, the sweep is read only and split by sorted position
+void SweepAndPrune::findPairsParallel(const CircleWorld& circles, JobSystem& jobs, std::vector<std::vector<CandidatePair>>& chunks) {
+  refresh(circles);
+  size_t chunkCount = jobs.size() * 4;
+  chunks.resize(chunkCount);
+  jobs.parallelFor(chunkCount, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t chunk = begin; chunk < end; ++chunk) {
+      chunks[chunk].clear();
+      sweep(chunk * intervals.size() / chunkCount, (chunk + 1) * intervals.size() / chunkCount, chunks[chunk]);
+    }
+  });
+}
@@ -0,0 +1,109 @@
+#include "uniform_grid.h"
+#include "kernels.h"
+#include "job_system.h"
+#include <algorithm>
+#include <cmath>
+
+void UniformGrid::build(const CircleWorld& circles) {
+  float maxX = circles.x[0];
+  float maxY = circles.y[0];
+  float maxRadius = 0.0f;
+  minX = circles.x[0];
+  minY = circles.y[0];
+  for (size_t i = 0; i < circles.size(); ++i) {
+    minX = std::min(minX, circles.x[i]);
+    minY = std::min(minY, circles.y[i]);
+    maxX = std::max(maxX, circles.x[i]);
+    maxY = std::max(maxY, circles.y[i]);
+    maxRadius = std::max(maxRadius, circles.radius[i]);
+  }
+
+  float width = maxX - minX;
+  float height = maxY - minY;
+  cell = 2.0f * maxRadius;
+  if (cell <= 0.0f) cell = std::max(std::max(width, height), 1.0f);
+
+  // Keep the cell count linear in the body count so rebuilding stays O(n)
+  size_t cellBudget = circles.size() * 4 + 16;
+  for (;;) {
+    cols = static_cast<int>(width / cell) + 1;
+    rows = static_cast<int>(height / cell) + 1;
+    if (static_cast<size_t>(cols) * static_cast<size_t>(rows) <= cellBudget) break;
+    cell *= 2.0f;
+  }
+
+  size_t cellCount = static_cast<size_t>(cols) * static_cast<size_t>(rows);
+  cellStart.assign(cellCount + 1, 0);
+  cellOf.resize(circles.size());
+  sorted.resize(circles.size());
+
+  physicsKernels().cellKeys(circles.x.data(), circles.y.data(), circles.size(), minX, minY, cell, cols, rows, cellOf.data());
+  for (size_t i = 0; i < circles.size(); ++i) {
+    cellStart[cellOf[i] + 1]++;
+  }
+  for (size_t c = 0; c < cellCount; ++c) {
+    cellStart[c + 1] += cellStart[c];
+  }
+
+  cursor.assign(cellStart.begin(), cellStart.end() - 1);
+  for (size_t i = 0; i < circles.size(); ++i) {
+    sorted[cursor[cellOf[i]]++] = static_cast<uint32_t>(i);
+  }
+}
+
+void UniformGrid::emitCellPairs(uint32_t cellA, uint32_t cellB, std::vector<CandidatePair>& pairs) const {
+  for (uint32_t i = cellStart[cellA]; i < cellStart[cellA + 1]; ++i) {
+    uint32_t a = sorted[i];
+    uint32_t j = cellA == cellB ? i + 1 : cellStart[cellB];
+    for (; j < cellStart[cellB + 1]; ++j) {
+      uint32_t b = sorted[j];
+      pairs.push_back(a < b ? CandidatePair{a, b} : CandidatePair{b, a});
+    }
+  }
+}
+
+void UniformGrid::emitRows(int firstRow, int lastRow, std::vector<CandidatePair>& pairs) const {
+  // Half stencil: each neighbouring cell pair is visited once
+  for (int cy = firstRow; cy < lastRow; ++cy) {
+    for (int cx = 0; cx < cols; ++cx) {
+      uint32_t home = static_cast<uint32_t>(cy * cols + cx);
+      if (cellStart[home] == cellStart[home + 1]) continue;
+
+      emitCellPairs(home, home, pairs);
+      if (cx + 1 < cols) emitCellPairs(home, home + 1, pairs);
+      if (cy + 1 < rows) {
+        uint32_t above = home + static_cast<uint32_t>(cols);
+        if (cx > 0) emitCellPairs(home, above - 1, pairs);
+        emitCellPairs(home, above, pairs);
+        if (cx + 1 < cols) emitCellPairs(home, above + 1, pairs);
+      }
+    }
+  }
+}
+
+void UniformGrid::findPairs(const CircleWorld& circles, std::vector<CandidatePair>& pairs) {
+  pairs.clear();
+  if (circles.size() < 2) return;
+  build(circles);
+  emitRows(0, rows, pairs);
+}
+
+void UniformGrid::findPairsParallel(const CircleWorld& circles, JobSystem& jobs, std::vector<std::vector<CandidatePair>>& chunks) {
+  if (circles.size() < 2) {
+    chunks.clear();
+    return;
+  }
+  build(circles);
+
+  // Horizontal bands of rows; the grid is read only while pairs are emitted
+  size_t bandCount = std::min<size_t>(static_cast<size_t>(rows), jobs.size() * 4);
+  chunks.resize(bandCount);
+  jobs.parallelFor(bandCount, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t band = begin; band < end; ++band) {
+      int firstRow = static_cast<int>(band * rows / bandCount);
+      int lastRow = static_cast<int>((band + 1) * rows / bandCount);
+      chunks[band].clear();
+      emitRows(firstRow, lastRow, chunks[band]);
+    }
+  });
+}
@@ -0,0 +1,640 @@
+#include "world.h"
+#include "aabb_tree.h"
+#include "kernels.h"
+#include "narrowphase.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+// Ends an island's list of sleepers
+static constexpr uint32_t endOfIsland = std::numeric_limits<uint32_t>::max();
+
+World::World() {
+  setBroadphase(broadphaseType);
+}
+
+void World::setThreadCount(unsigned threads) {
+  if (threads <= 1) jobs.reset();
+  else jobs = std::make_unique<JobSystem>(threads);
+  buildStepGraph();
+}
+
+void World::setBroadphase(BroadphaseKind kind) {
+  broadphaseType = kind;
+  broadphase = createBroadphase(kind);
+}
+
+void World::setDomainCount(size_t count) {
+  domainsWanted = count;
+  if (count > 1) domains.setDomainCount(count);
+}
+
+void World::setSleepSettings(const SleepSettings& settings) {
+  sleepConfig = settings;
+  if (!sleepConfig.enabled) wakeAll();
+}
+
+void World::setForceField(std::unique_ptr<ForceField> forceField) {
+  field = std::move(forceField);
+  integrator.invalidate();
+  if (field) wakeAll();
+}
+
+void World::addCircle(const Circle& circle) {
+  bodies.add(circle);
+  domains.invalidate();
+  integrator.invalidate();
+  awake.push_back(1);
+  staleInstance.push_back(0);
+  restTime.push_back(0.0f);
+  islandOf.push_back(0);
+  islandFirst.push_back(endOfIsland);
+  islandNext.push_back(endOfIsland);
+}
+
+void World::removeCircle(size_t i) {
+  size_t last = bodies.size() - 1;
+  // Whatever rested on either circle may have lost its support. Waking both islands also means no
+  // sleeping circle is left naming i or last as its island.
+  wakeBody(i);
+  wakeBody(last);
+
+  bodies.remove(i);
+  if (broadphase) broadphase->circleRemoved(static_cast<uint32_t>(i), static_cast<uint32_t>(last));
+  domains.invalidate();
+  // Cached impulses are keyed on indices, and last now answers to i
+  solver.clearCache();
+  integrator.invalidate();
+  awake[i] = awake[last];
+  staleInstance[i] = staleInstance[last];
+  restTime[i] = restTime[last];
+  islandOf[i] = islandOf[last];
+  islandFirst[i] = islandFirst[last];
+  islandNext[i] = islandNext[last];
+  awake.pop_back();
+  staleInstance.pop_back();
+  restTime.pop_back();
+  islandOf.pop_back();
+  islandFirst.pop_back();
+  islandNext.pop_back();
+
+  // Keep the interpolation snapshot lined up with the circles
+  if (previousX.size() > last) {
+    previousX[i] = previousX[last];
+    previousY[i] = previousY[last];
+    previousX.pop_back();
+    previousY.pop_back();
+  }
+}
+
+void World::applyImpulse(size_t i, float impulseX, float impulseY) {
+  wakeBody(i);
+  bodies.vx[i] += impulseX * bodies.invMass[i];
+  bodies.vy[i] += impulseY * bodies.invMass[i];
+}
+
+void World::wakeBody(size_t i) {
+  if (awake[i]) return;
+  pendingWakes.assign(1, islandOf[i]);
+  wakeIslands(pendingWakes);
+}
+
+void World::clear() {
+  bodies.clear();
+  domains.invalidate();
+  solver.clearCache();
+  integrator.invalidate();
+  previousX.clear();
+  previousY.clear();
+  awake.clear();
+  staleInstance.clear();
+  restTime.clear();
+  islandOf.clear();
+  islandFirst.clear();
+  islandNext.clear();
+  sleepingBodies = 0;
+}
+
+void World::wakeAll() {
+  for (size_t i = 0; i < bodies.size(); ++i) {
+    awake[i] = 1;
+    restTime[i] = 0.0f;
+  }
+  islandFirst.assign(bodies.size(), endOfIsland);
+  sleepingBodies = 0;
+}
+
+void World::applyCommands() {
+  // Bounded so producers that keep pushing cannot hold up the step
+  Command command;
+  for (size_t applied = 0; applied < commands.capacity() && commands.pop(command); ++applied) {
+    switch (command.type) {
+    case Command::Type::Spawn:
+      addCircle(Circle(command.x, command.y, command.vx, command.vy, command.radius, command.mass));
+      break;
+    case Command::Type::Remove:
+      if (command.body < bodies.size()) removeCircle(command.body);
+      break;
+    case Command::Type::Impulse:
+      if (command.body < bodies.size()) applyImpulse(command.body, command.impulseX, command.impulseY);
+      break;
+    case Command::Type::Reset:
+      clear();
+      break;
+    case Command::Type::SetBroadphase:
+      setBroadphase(command.broadphase);
+      break;
+    }
+  }
+}
+
+const char* stepLimitName(StepLimit limit) {
+  switch (limit) {
+    case StepLimit::Fixed: return "fixed";
+    case StepLimit::Requested: return "requested";
+    case StepLimit::MaxStep: return "max step";
+    case StepLimit::Growth: return "growth";
+    case StepLimit::Speed: return "speed";
+    case StepLimit::Penetration: return "penetration";
+    case StepLimit::MinStep: return "min step";
+  }
+  return "unknown";
+}
+
+void World::step(float dt) {
+  // Commands land before any phase runs, so the whole step sees one set of circles
+  applyCommands();
+  measureContacts = false;
+  advance(dt, StepLimit::Fixed);
+}
+
+float World::stepAdaptive(float limit) {
+  applyCommands();
+  if (bodies.empty()) return 0.0f;
+
+  const AdaptiveStepSettings& config = adaptiveConfig;
+  float dt = config.maxStep;
+  StepLimit reason = StepLimit::MaxStep;
+  auto tighten = [&](float candidate, StepLimit why) {
+    if (candidate < dt) {
+      dt = candidate;
+      reason = why;
+    }
+  };
+  if (plannedStep > 0.0f) tighten(plannedStep * config.growth, StepLimit::Growth);
+  float rate = fastestRate();
+  if (rate > 0.0f) tighten(config.courant / rate, StepLimit::Speed);
+  // Contacts sink roughly in proportion to the step, so scale the last one to the allowed depth
+  if (measureContacts && contactDepth > 0.0f && lastStep > 0.0f) {
+    tighten(lastStep * config.maxPenetration / contactDepth, StepLimit::Penetration);
+  }
+  if (dt < config.minStep) {
+    dt = config.minStep;
+    reason = StepLimit::MinStep;
+  }
+  // A step cut short to land on limit does not hold back the ones after it
+  plannedStep = dt;
+  tighten(limit, StepLimit::Requested);
+
+  measureContacts = config.maxPenetration > 0.0f;
+  contactDepth = 0.0f;
+  advance(dt, reason);
+  return dt;
+}
+
+// Largest speed over radius of any circle, the rate at which it covers its own size
+float World::fastestRate() const {
+  auto scan = [&](size_t begin, size_t end) {
+    float fastest = 0.0f;
+    for (size_t i = begin; i < end; ++i) {
+      float speedSq = bodies.vx[i] * bodies.vx[i] + bodies.vy[i] * bodies.vy[i];
+      fastest = std::max(fastest, speedSq / (bodies.radius[i] * bodies.radius[i]));
+    }
+    return fastest;
+  };
+  if (!jobs) return std::sqrt(scan(0, bodies.size()));
+
+  threadRates.assign(jobs->size(), 0.0f);
+  jobs->parallelFor(bodies.size(), 16384, [&](size_t begin, size_t end, unsigned thread) {
+    threadRates[thread] = std::max(threadRates[thread], scan(begin, end));
+  });
+  return std::sqrt(*std::max_element(threadRates.begin(), threadRates.end()));
+}
+
+// How far the last step pushed touching pairs into each other, relative to the smaller radius. Only
+// what closing speed could have added in one step counts, so overlaps that persist in a resting pile,
+// which a smaller step would not undo, do not hold the step size down.
+float World::deepestContact(const CandidatePair* pairs, size_t count) const {
+  float deepest = 0.0f;
+  for (size_t k = 0; k < count; ++k) {
+    uint32_t a = pairs[k].a;
+    uint32_t b = pairs[k].b;
+    float dx = bodies.x[a] - bodies.x[b];
+    float dy = bodies.y[a] - bodies.y[b];
+    float minDist = bodies.radius[a] + bodies.radius[b];
+    float distSq = dx * dx + dy * dy;
+    if (distSq >= minDist * minDist || distSq <= 0.0f) continue;
+    float dist = std::sqrt(distSq);
+    float closing = -((bodies.vx[a] - bodies.vx[b]) * dx + (bodies.vy[a] - bodies.vy[b]) * dy) / dist;
+    if (closing <= 0.0f) continue;
+    float depth = std::min(minDist - dist, closing * lastStep);
+    deepest = std::max(deepest, depth / std::min(bodies.radius[a], bodies.radius[b]));
+  }
+  return deepest;
+}
+
+void World::advance(float dt, StepLimit limit) {
+  if (bodies.empty()) return;
+  if (usesDomains()) {
+    worldStats.pairTests += domains.resolveCollisions(bodies, sleepingBodies > 0 ? awake.data() : nullptr, *jobs);
+    // A domain resolves contacts with a sleeping circle like any other, the island wakes before it moves
+    if (sleepingBodies > 0) {
+      pendingWakes.clear();
+      for (const std::vector<CandidatePair>& chunk : domains.contactChunks()) {
+        collectWakes(chunk.data(), chunk.size(), pendingWakes);
+      }
+      wakeIslands(pendingWakes);
+    }
+    integrate(dt);
+    updateSleep(dt);
+  }
+  else if (jobs && broadphase) {
+    stepDt = dt;
+    jobs->run(stepGraph);
+  }
+  else {
+    // Collisions first so the fused integrate and wall pass leaves every circle inside the box
+    resolveCollisions();
+    integrate(dt);
+    updateSleep(dt);
+  }
+  lastStep = dt;
+  worldStats.steps++;
+  worldStats.time += dt;
+  worldStats.dt = dt;
+  worldStats.dtLimit = limit;
+  worldStats.limitedSteps[static_cast<int>(limit)]++;
+}
+
+// The threaded step as a graph. Clearing the colour masks only needs the body count, so it
+// overlaps the broadphase and the wake pass; everything else is a chain, each phase a parallelFor
+// of its own.
+void World::buildStepGraph() {
+  stepGraph.clear();
+  if (!jobs) return;
+
+  TaskGraph::Node contacts = stepGraph.add([this] {
+    worldStats.pairTests += pipeline.findContacts(bodies, *broadphase, *jobs);
+    if (!measureContacts) return;
+    std::vector<std::vector<CandidatePair>>& chunks = pipeline.contactChunks();
+    chunkDepths.assign(chunks.size(), 0.0f);
+    jobs->parallelFor(chunks.size(), 1, [&](size_t begin, size_t end, unsigned) {
+      for (size_t c = begin; c < end; ++c) {
+        chunkDepths[c] = deepestContact(chunks[c].data(), chunks[c].size());
+      }
+    });
+    for (float depth : chunkDepths) {
+      contactDepth = std::max(contactDepth, depth);
+    }
+  });
+  TaskGraph::Node wake = stepGraph.add([this] {
+    if (sleepingBodies == 0) return;
+    std::vector<std::vector<CandidatePair>>& chunks = pipeline.contactChunks();
+    chunkWakes.resize(chunks.size());
+    jobs->parallelFor(chunks.size(), 1, [&](size_t begin, size_t end, unsigned) {
+      for (size_t c = begin; c < end; ++c) {
+        chunkWakes[c].clear();
+        collectWakes(chunks[c].data(), chunks[c].size(), chunkWakes[c]);
+      }
+    });
+    pendingWakes.clear();
+    for (const std::vector<uint32_t>& islands : chunkWakes) {
+      pendingWakes.insert(pendingWakes.end(), islands.begin(), islands.end());
+    }
+    wakeIslands(pendingWakes);
+    jobs->parallelFor(chunks.size(), 1, [&](size_t begin, size_t end, unsigned) {
+      for (size_t c = begin; c < end; ++c) {
+        chunks[c].resize(dropSleepingPairs(chunks[c].data(), chunks[c].size()));
+      }
+    });
+  });
+  TaskGraph::Node masks = stepGraph.add([this] { pipeline.clearMasks(bodies.size(), *jobs); });
+  TaskGraph::Node color = stepGraph.add([this] { pipeline.colorContacts(*jobs); });
+  TaskGraph::Node resolve = stepGraph.add([this] {
+    if (solver.settings().enabled) {
+      solver.solveBatches(bodies, pipeline.coloredContacts().data(), pipeline.colorOffsets(),
+                          ParallelPipeline::maxColors, *jobs);
+    }
+    else {
+      pipeline.resolveColors(bodies, *jobs);
+    }
+  });
+  TaskGraph::Node move = stepGraph.add([this] { integrate(stepDt); });
+  TaskGraph::Node rest = stepGraph.add([this] { updateSleep(stepDt); });
+
+  stepGraph.precede(contacts, wake);
+  stepGraph.precede(wake, color);
+  stepGraph.precede(masks, color);
+  stepGraph.precede(color, resolve);
+  stepGraph.precede(resolve, move);
+  stepGraph.precede(move, rest);
+}
+
+void World::packInstances(std::vector<float>& out, float alpha) const {
+  out.resize(bodies.size() * 2);
+  packInstances(out.data(), alpha);
+}
+
+void World::packInstances(float* out, float alpha) const {
+  if (jobs) {
+    jobs->parallelFor(bodies.size(), 16384, [&](size_t begin, size_t end, unsigned) {
+      packRange(out, begin, end, alpha);
+    });
+  }
+  else {
+    packRange(out, 0, bodies.size(), alpha);
+  }
+}
+
+void World::packInstanceRanges(float* out, float alpha, std::vector<BodyRange>& ranges) {
+  ranges.clear();
+  size_t n = bodies.size();
+  if (sleepingBodies == 0) {
+    packInstances(out, alpha);
+    std::fill(staleInstance.begin(), staleInstance.end(), 0);
+    if (n > 0) ranges.push_back(BodyRange{0, n});
+    return;
+  }
+
+  for (size_t i = 0; i < n;) {
+    if (!awake[i] && !staleInstance[i]) {
+      ++i;
+      continue;
+    }
+    size_t begin = i;
+    while (i < n && (awake[i] || staleInstance[i])) {
+      staleInstance[i] = 0;
+      ++i;
+    }
+    packRange(out, begin, i, alpha);
+    ranges.push_back(BodyRange{begin, i});
+  }
+}
+
+void World::packPreviousInstances(float* out, const std::vector<BodyRange>& ranges) const {
+  for (const BodyRange& range : ranges) {
+    packRange(out, range.begin, range.end, 0.0f);
+  }
+}
+
+void World::packRange(float* out, size_t begin, size_t end, float alpha) const {
+  const float* x = bodies.x.data();
+  const float* y = bodies.y.data();
+
+  // Circles added since the last snapshot have nothing to blend from
+  size_t blended = alpha < 1.0f ? std::min(previousX.size(), bodies.size()) : 0;
+  const float* px = previousX.data();
+  const float* py = previousY.data();
+  for (size_t i = begin; i < std::min(end, blended); ++i) {
+    out[2 * i] = px[i] + (x[i] - px[i]) * alpha;
+    out[2 * i + 1] = py[i] + (y[i] - py[i]) * alpha;
+  }
+  for (size_t i = std::max(begin, blended); i < end; ++i) {
+    out[2 * i] = x[i];
+    out[2 * i + 1] = y[i];
+  }
+}
+
+void World::storePreviousPositions() {
+  previousX.resize(bodies.size());
+  previousY.resize(bodies.size());
+  auto copy = [&](size_t begin, size_t end, unsigned) {
+    std::copy(bodies.x.begin() + begin, bodies.x.begin() + end, previousX.begin() + begin);
+    std::copy(bodies.y.begin() + begin, bodies.y.begin() + end, previousY.begin() + begin);
+  };
+
+  if (jobs) jobs->parallelFor(bodies.size(), 16384, copy);
+  else copy(0, bodies.size(), 0);
+}
+
+void World::queryRegion(const Aabb& region, std::vector<uint32_t>& out) {
+  if (AabbTree* tree = dynamic_cast<AabbTree*>(broadphase.get())) {
+    tree->update(bodies);
+    tree->queryRegion(region, bodies, out);
+    return;
+  }
+
+  for (size_t i = 0; i < bodies.size(); ++i) {
+    float r = bodies.radius[i];
+    Aabb box{bodies.x[i] - r, bodies.y[i] - r, bodies.x[i] + r, bodies.y[i] + r};
+    if (box.overlaps(region)) out.push_back(static_cast<uint32_t>(i));
+  }
+}
+
+void World::integrate(float dt) {
+  // Circles that need substeps are set aside here and stepped on their own once the passes below are done
+  size_t substepped = field ? 0 : multiRateStepper.prepare(bodies, awake.data(), dt, multiRateConfig, jobs.get());
+  if (substepped > 0 && !multiRateStepper.touched().empty()) {
+    // Sleepers in reach of a fast circle wake and are picked again, so they are substepped with it
+    pendingWakes.clear();
+    collectWakes(multiRateStepper.touched().data(), multiRateStepper.touched().size(), pendingWakes);
+    wakeIslands(pendingWakes);
+    substepped = multiRateStepper.prepare(bodies, awake.data(), dt, multiRateConfig, jobs.get());
+  }
+  worldStats.substeppedBodies += substepped;
+
+  // Otherwise fast circles are bounced at their first impact here, leaving a straight step for the passes below
+  size_t swept = substepped > 0 ? 0 : ccd.sweep(bodies, dt, -1.0f, 1.0f, ccdConfig, jobs.get());
+  if (swept > 0) {
+    worldStats.sweptBodies += swept;
+    if (sleepingBodies > 0) {
+      pendingWakes.clear();
+      collectWakes(ccd.impacts().data(), ccd.impacts().size(), pendingWakes);
+      wakeIslands(pendingWakes);
+    }
+  }
+
+  if (field) {
+    // Everything is awake under a field. Contact pushes are small enough to keep Verlet's cached forces.
+    integrator.step(bodies, *field, dt, -1.0f, 1.0f, jobs.get());
+    return;
+  }
+
+  const PhysicsKernels& kernels = physicsKernels();
+  auto integrateRange = [&](size_t begin, size_t end) {
+    kernels.integrateBounded(bodies.x.data() + begin, bodies.y.data() + begin, bodies.vx.data() + begin,
+                             bodies.vy.data() + begin, bodies.radius.data() + begin, end - begin, dt, -1.0f, 1.0f);
+  };
+
+  // Sleeping bodies are skipped a run of awake ones at a time
+  auto integrateBlock = [&](size_t begin, size_t end, unsigned) {
+    if (sleepingBodies == 0) {
+      integrateRange(begin, end);
+      return;
+    }
+    for (size_t i = begin; i < end;) {
+      if (!awake[i]) {
+        ++i;
+        continue;
+      }
+      size_t first = i;
+      while (i < end && awake[i]) ++i;
+      integrateRange(first, i);
+    }
+  };
+
+  // Blocks are a multiple of every vector width, so only the last one has a scalar tail
+  if (jobs) jobs->parallelFor(bodies.size(), 16384, integrateBlock);
+  else integrateBlock(0, bodies.size(), 0);
+  if (substepped > 0) multiRateStepper.finish(bodies);
+}
+
+void World::resolveCollisions() {
+  if (broadphase) {
+    broadphase->findPairs(bodies, candidatePairs);
+    worldStats.pairTests += candidatePairs.size();
+  }
+  else {
+    // Every pair is a candidate, only touching ones are kept
+    candidatePairs.clear();
+    for (size_t i = 0; i < bodies.size(); ++i) {
+      for (size_t j = i + 1; j < bodies.size(); ++j) {
+        float dx = bodies.x[i] - bodies.x[j];
+        float dy = bodies.y[i] - bodies.y[j];
+        float minDist = bodies.radius[i] + bodies.radius[j];
+        if (dx * dx + dy * dy < minDist * minDist) {
+          candidatePairs.push_back(CandidatePair{static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
+        }
+      }
+    }
+    worldStats.pairTests += bodies.size() * (bodies.size() - 1) / 2;
+  }
+  if (measureContacts) contactDepth = deepestContact(candidatePairs.data(), candidatePairs.size());
+
+  if (sleepConfig.enabled || solver.settings().enabled) wakeTouched(candidatePairs);
+  if (solver.settings().enabled) solver.solve(bodies, candidatePairs.data(), candidatePairs.size());
+  else resolvePairsBatched(bodies, candidatePairs.data(), candidatePairs.size(), narrowphaseScratch);
+}
+
+// Narrows candidates down to touching pairs, wakes sleeping islands an awake body touches and drops
+// pairs that are still asleep on both sides
+void World::wakeTouched(std::vector<CandidatePair>& contacts) {
+  const PhysicsKernels& kernels = physicsKernels();
+  contacts.resize(kernels.filterContacts(bodies.x.data(), bodies.y.data(), bodies.radius.data(),
+                                         contacts.data(), contacts.size(), contacts.data()));
+  if (sleepingBodies == 0) return;
+
+  pendingWakes.clear();
+  collectWakes(contacts.data(), contacts.size(), pendingWakes);
+  wakeIslands(pendingWakes);
+  contacts.resize(dropSleepingPairs(contacts.data(), contacts.size()));
+}
+
+void World::collectWakes(const CandidatePair* contacts, size_t count, std::vector<uint32_t>& islands) const {
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t a = contacts[i].a;
+    uint32_t b = contacts[i].b;
+    if (awake[a] == awake[b]) continue;
+    islands.push_back(islandOf[awake[a] ? b : a]);
+  }
+}
+
+// Walks each island's list of sleepers, so a wake costs the size of the islands it wakes. An island
+// named twice is empty the second time round.
+void World::wakeIslands(const std::vector<uint32_t>& islands) {
+  for (uint32_t island : islands) {
+    uint32_t i = islandFirst[island];
+    islandFirst[island] = endOfIsland;
+    while (i != endOfIsland) {
+      awake[i] = 1;
+      restTime[i] = 0.0f;
+      sleepingBodies--;
+      i = islandNext[i];
+    }
+  }
+}
+
+size_t World::dropSleepingPairs(CandidatePair* contacts, size_t count) const {
+  size_t kept = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (awake[contacts[i].a] || awake[contacts[i].b]) contacts[kept++] = contacts[i];
+  }
+  return kept;
+}
+
+uint32_t World::findIsland(uint32_t i) {
+  while (islandParent[i] != i) {
+    islandParent[i] = islandParent[islandParent[i]];
+    i = islandParent[i];
+  }
+  return i;
+}
+
+// Advances rest timers and, once some body has rested long enough, groups awake bodies into islands
+// over this step's contacts. An island sleeps only when every body in it has rested long enough.
+void World::updateSleep(float dt) {
+  if (!sleepConfig.enabled || field) return;
+  size_t n = bodies.size();
+  float limit = sleepConfig.speedThreshold * sleepConfig.speedThreshold;
+
+  std::atomic<bool> ready{false};
+  auto advance = [&](size_t begin, size_t end, unsigned) {
+    bool any = false;
+    for (size_t i = begin; i < end; ++i) {
+      if (!awake[i]) continue;
+      float speed = bodies.vx[i] * bodies.vx[i] + bodies.vy[i] * bodies.vy[i];
+      restTime[i] = speed > limit ? 0.0f : restTime[i] + dt;
+      any |= restTime[i] >= sleepConfig.timeToSleep;
+    }
+    if (any) ready.store(true, std::memory_order_relaxed);
+  };
+  if (jobs) jobs->parallelFor(n, 16384, advance);
+  else advance(0, n, 0);
+  if (!ready.load()) return;
+
+  islandParent.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    islandParent[i] = static_cast<uint32_t>(i);
+  }
+  auto link = [&](const std::vector<CandidatePair>& contacts) {
+    for (const CandidatePair& pair : contacts) {
+      uint32_t a = findIsland(pair.a);
+      uint32_t b = findIsland(pair.b);
+      if (a != b) islandParent[std::max(a, b)] = std::min(a, b);
+    }
+  };
+  if (usesDomains()) {
+    for (const std::vector<CandidatePair>& chunk : domains.contactChunks()) {
+      link(chunk);
+    }
+  }
+  else if (jobs && broadphase) {
+    for (const std::vector<CandidatePair>& chunk : pipeline.contactChunks()) {
+      link(chunk);
+    }
+  }
+  else {
+    link(candidatePairs);
+  }
+
+  islandRest.assign(n, std::numeric_limits<float>::max());
+  for (size_t i = 0; i < n; ++i) {
+    if (!awake[i]) continue;
+    uint32_t root = findIsland(static_cast<uint32_t>(i));
+    islandRest[root] = std::min(islandRest[root], restTime[i]);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (!awake[i]) continue;
+    uint32_t root = findIsland(static_cast<uint32_t>(i));
+    if (islandRest[root] < sleepConfig.timeToSleep) continue;
+    awake[i] = 0;
+    staleInstance[i] = 1;
+    islandOf[i] = root;
+    islandNext[i] = islandFirst[root];
+    islandFirst[root] = static_cast<uint32_t>(i);
+    bodies.vx[i] = 0.0f;
+    bodies.vy[i] = 0.0f;
+    sleepingBodies++;
+  }
+}
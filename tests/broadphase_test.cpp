@@ -0,0 +1,121 @@
+#include "broadphase.h"
+#include "circle.h"
+#include "job_system.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <fmt/core.h>
+
+// Every broadphase has to report exactly the touching pairs the brute force loop finds, serial and
+// parallel, while circles move, arrive and leave between steps.
+
+static bool touching(const CircleWorld& circles, uint32_t a, uint32_t b) {
+  float dx = circles.x[a] - circles.x[b];
+  float dy = circles.y[a] - circles.y[b];
+  float reach = circles.radius[a] + circles.radius[b];
+  return dx * dx + dy * dy <= reach * reach;
+}
+
+static std::vector<uint64_t> bruteForce(const CircleWorld& circles) {
+  std::vector<uint64_t> pairs;
+  for (uint32_t a = 0; a < circles.size(); ++a) {
+    for (uint32_t b = a + 1; b < circles.size(); ++b) {
+      if (touching(circles, a, b)) pairs.push_back(uint64_t(a) << 32 | b);
+    }
+  }
+  return pairs;
+}
+
+// Touching pairs among candidates, sorted, with duplicates kept so they show up as a mismatch
+static std::vector<uint64_t> touchingPairs(const CircleWorld& circles, const std::vector<CandidatePair>& candidates) {
+  std::vector<uint64_t> pairs;
+  for (const CandidatePair& pair : candidates) {
+    if (pair.a >= pair.b) return {};
+    if (touching(circles, pair.a, pair.b)) pairs.push_back(uint64_t(pair.a) << 32 | pair.b);
+  }
+  std::sort(pairs.begin(), pairs.end());
+  return pairs;
+}
+
+static Circle randomCircle(std::mt19937& rng, bool clustered) {
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  // Mostly small circles, a few large enough to span many grid cells
+  float radius = unit(rng) < 0.02f ? 0.1f + 0.1f * unit(rng) : 0.002f + 0.028f * unit(rng);
+  float x = -1.0f + radius + (2.0f - 2.0f * radius) * unit(rng);
+  float y = -1.0f + radius + (2.0f - 2.0f * radius) * unit(rng);
+  if (clustered) {
+    // Pressed against a wall or into a corner
+    float side = unit(rng) < 0.5f ? -1.0f : 1.0f;
+    float depth = 0.05f * unit(rng);
+    if (unit(rng) < 0.5f) x = side * (1.0f - radius - depth);
+    else y = side * (1.0f - radius - depth);
+  }
+  return Circle(x, y, 0.0f, 0.0f, radius, 1.0f);
+}
+
+// Nudges every circle, then swaps a few out and brings a few in, the way World does between steps
+static void perturb(CircleWorld& circles, std::vector<Broadphase*> broadphases, std::mt19937& rng, bool clustered) {
+  std::normal_distribution<float> jitter(0.0f, 0.01f);
+  for (size_t i = 0; i < circles.size(); ++i) {
+    float r = circles.radius[i];
+    circles.x[i] = std::clamp(circles.x[i] + jitter(rng), r - 1.0f, 1.0f - r);
+    circles.y[i] = std::clamp(circles.y[i] + jitter(rng), r - 1.0f, 1.0f - r);
+  }
+  for (int k = 0; k < 10 && !circles.empty(); ++k) {
+    size_t i = rng() % circles.size();
+    size_t last = circles.size() - 1;
+    circles.remove(i);
+    for (Broadphase* broadphase : broadphases) {
+      broadphase->circleRemoved(static_cast<uint32_t>(i), static_cast<uint32_t>(last));
+    }
+  }
+  for (int k = 0; k < 15; ++k) {
+    circles.add(randomCircle(rng, clustered));
+  }
+}
+
+int main() {
+  JobSystem jobs(4);
+  int failures = 0;
+  for (int clustered = 0; clustered < 2; ++clustered) {
+    for (int kind = 0; kind < broadphaseKindCount; ++kind) {
+      BroadphaseKind broadphaseKind = static_cast<BroadphaseKind>(kind);
+      std::unique_ptr<Broadphase> serial = createBroadphase(broadphaseKind);
+      std::unique_ptr<Broadphase> parallel = createBroadphase(broadphaseKind);
+      // World runs brute force as its own nested loop, so there is nothing to compare
+      if (!serial) continue;
+
+      std::mt19937 rng(1234 + clustered);
+      CircleWorld circles;
+      for (int i = 0; i < 1500; ++i) {
+        circles.add(randomCircle(rng, clustered));
+      }
+      std::vector<CandidatePair> candidates;
+      std::vector<std::vector<CandidatePair>> chunks;
+      for (int step = 0; step < 8; ++step) {
+        std::vector<uint64_t> expected = bruteForce(circles);
+
+        serial->findPairs(circles, candidates);
+        bool serialMatches = touchingPairs(circles, candidates) == expected;
+
+        parallel->findPairsParallel(circles, jobs, chunks);
+        candidates.clear();
+        for (const std::vector<CandidatePair>& chunk : chunks) {
+          candidates.insert(candidates.end(), chunk.begin(), chunk.end());
+        }
+        bool parallelMatches = touchingPairs(circles, candidates) == expected;
+
+        if (!serialMatches || !parallelMatches) {
+          const char* which = !serialMatches && !parallelMatches ? "serial and parallel" : !serialMatches ? "serial" : "parallel";
+          fmt::print(stderr, "{} on {} circles, step {}: {} pairs differ from brute force ({} touching)\n",
+                     broadphaseName(broadphaseKind), clustered ? "clustered" : "scattered", step, which, expected.size());
+          failures++;
+          break;
+        }
+        perturb(circles, {serial.get(), parallel.get()}, rng, clustered);
+      }
+    }
+  }
+  if (failures == 0) fmt::print("Every broadphase matched brute force.\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,7 @@
+#pragma once
+// Stands in for the glad loader in tests. GL entry points are plain prototypes here, defined by the
+// test itself, instead of function pointers loaded from a driver.
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+
+extern int GLAD_GL_ARB_buffer_storage;
@@ -0,0 +1,104 @@
+#include "instance_ring.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <fmt/core.h>
+
+// InstanceRing against a fake GL that keeps buffers in memory and signals every fence at once. The
+// region each frame draws from has to hold exactly what was uploaded, whether the buffer is mapped
+// persistently, mapped per frame, or falls back after the persistent mapping fails.
+
+int GLAD_GL_ARB_buffer_storage = 0;
+
+static std::vector<std::vector<char>> buffers(1); // Buffer 0 is never handed out
+static GLuint bound = 0;
+static GLuint drawnBuffer = 0;
+static size_t drawnOffset = 0;
+static bool failPersistentMap = false;
+
+extern "C" {
+void glGenBuffers(GLsizei, GLuint* buffer) {
+  buffers.emplace_back();
+  *buffer = static_cast<GLuint>(buffers.size() - 1);
+}
+void glDeleteBuffers(GLsizei, const GLuint* buffer) { buffers[*buffer].clear(); }
+void glBindBuffer(GLenum, GLuint buffer) { bound = buffer; }
+void glBufferStorage(GLenum, GLsizeiptr size, const void*, GLbitfield) { buffers[bound].assign(size, 0); }
+void glBufferData(GLenum, GLsizeiptr size, const void*, GLenum) { buffers[bound].assign(size, 0); }
+void* glMapBufferRange(GLenum, GLintptr offset, GLsizeiptr, GLbitfield access) {
+  if (failPersistentMap && (access & GL_MAP_PERSISTENT_BIT)) return nullptr;
+  return buffers[bound].data() + offset;
+}
+GLboolean glUnmapBuffer(GLenum) { return GL_TRUE; }
+void glFlushMappedBufferRange(GLenum, GLintptr, GLsizeiptr) {}
+GLsync glFenceSync(GLenum, GLbitfield) { return reinterpret_cast<GLsync>(1); }
+void glDeleteSync(GLsync) {}
+GLenum glClientWaitSync(GLsync, GLbitfield, GLuint64) { return GL_ALREADY_SIGNALED; }
+void glVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void* pointer) {
+  drawnBuffer = bound;
+  drawnOffset = reinterpret_cast<size_t>(pointer);
+}
+}
+
+int main() {
+  struct Mode {
+    const char* name;
+    bool bufferStorage;
+    bool failMap;
+  };
+  const Mode modes[] = {{"persistent", true, false}, {"per frame", false, false}, {"failed persistent", true, true}};
+
+  int failures = 0;
+  for (const Mode& mode : modes) {
+    GLAD_GL_ARB_buffer_storage = mode.bufferStorage;
+    failPersistentMap = mode.failMap;
+    InstanceRing ring;
+    ring.create();
+
+    std::mt19937 rng(11);
+    std::vector<float> data;
+    size_t count = 0;
+    for (int frame = 0; frame < 3000; ++frame) {
+      std::vector<BodyRange> ranges;
+      if (frame % 500 == 0) {
+        // A new count, sometimes past the buffer's capacity, invalidates every region
+        count = 100 + rng() % 3000;
+        data.resize(count * 2);
+        for (float& value : data) {
+          value = static_cast<float>(rng() % 1000);
+        }
+        ranges.push_back(BodyRange{0, count});
+      }
+      else {
+        for (int k = 0; k < 3; ++k) {
+          size_t begin = rng() % count;
+          size_t end = std::min(count, begin + rng() % 50);
+          if (end == begin) continue;
+          for (size_t i = begin * 2; i < end * 2; ++i) {
+            data[i] = static_cast<float>(rng() % 1000);
+          }
+          ranges.push_back(BodyRange{begin, end});
+        }
+        std::sort(ranges.begin(), ranges.end(), [](const BodyRange& a, const BodyRange& b) { return a.begin < b.begin; });
+      }
+
+      ring.upload(data.data(), count, ranges);
+      ring.bindAttribute(0);
+      const char* drawn = buffers[drawnBuffer].data() + drawnOffset;
+      if (std::memcmp(drawn, data.data(), count * 2 * sizeof(float)) != 0) {
+        fmt::print(stderr, "{}: frame {} drew a region that differs from the uploaded data\n", mode.name, frame);
+        failures++;
+        break;
+      }
+      ring.fence();
+    }
+    if (ring.persistent() != (mode.bufferStorage && !mode.failMap)) {
+      fmt::print(stderr, "{}: persistent mapping is {}\n", mode.name, ring.persistent() ? "on" : "off");
+      failures++;
+    }
+    ring.destroy();
+  }
+  if (failures == 0) fmt::print("Every drawn region matched the uploaded data.\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#include "job_system.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <fmt/core.h>
+
+// parallelFor has to visit every index exactly once. Halving leaves pieces as short as
+// (grain + 1) / 2, so small even grains at these counts used to run past the end of the task arena.
+// Calls from the workers of another job system have to work too.
+int main() {
+  JobSystem jobs(4);
+  struct Case {
+    size_t grain;
+    size_t count;
+  };
+  const Case cases[] = {{2, 11}, {2, 12}, {2, 1000}, {4, 37}, {64, 4160}, {256, 65792}, {1024, 1049600}};
+
+  int failures = 0;
+  for (const Case& c : cases) {
+    std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[c.count]);
+    for (size_t i = 0; i < c.count; ++i) {
+      visits[i].store(0);
+    }
+    jobs.parallelFor(c.count, c.grain, [&](size_t begin, size_t end, unsigned) {
+      for (size_t i = begin; i < end; ++i) {
+        visits[i].fetch_add(1);
+      }
+    });
+    for (size_t i = 0; i < c.count; ++i) {
+      if (visits[i].load() != 1) {
+        fmt::print(stderr, "grain {} count {}: index {} visited {} times\n", c.grain, c.count, i, visits[i].load());
+        failures++;
+        break;
+      }
+    }
+  }
+  // Workers of one system calling into a smaller one have to join it as an outside thread, not with
+  // their own index, which the smaller system has no deque for. Outside callers take turns.
+  JobSystem small(2);
+  std::mutex turn;
+  std::atomic<size_t> nestedVisits{0};
+  std::atomic<bool> badThread{false};
+  jobs.parallelFor(64, 1, [&](size_t begin, size_t end, unsigned) {
+    for (size_t i = begin; i < end; ++i) {
+      std::lock_guard<std::mutex> lock(turn);
+      small.parallelFor(256, 4, [&](size_t first, size_t last, unsigned thread) {
+        if (thread >= small.size()) badThread = true;
+        nestedVisits.fetch_add(last - first);
+      });
+    }
+  });
+  if (badThread || nestedVisits != 64 * 256) {
+    fmt::print(stderr, "nested parallelFor: {} of {} indices, thread index {}\n", nestedVisits.load(), 64 * 256,
+               badThread ? "out of range" : "in range");
+    failures++;
+  }
+
+  if (failures == 0) fmt::print("parallelFor covered every index once.\n");
+  return failures == 0 ? 0 : 1;
+}